@@ -4,37 +4,214 @@
 #include <fstream>
 #include <vector>
 #include <chrono>
+#include <iomanip>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <bitset>
+#include <array>
+#include <bit>
+#include <type_traits>
 #include <unordered_map>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <tuple>
+#include <condition_variable>
+#include <memory>
+#include <charconv>
+#include <string_view>
+#include <span>
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
-using idx_t = size_t;
-using iVec = vector<idx_t>;
 using joltage_t = int;
 using joltVec = vector<joltage_t>;
-    using chrono::duration;
-    using chrono::duration_cast;
-    using chrono::high_resolution_clock;
-    using chrono::milliseconds;
-    using chrono::time_point;
-    using chrono::system_clock;
+using chrono::duration_cast;
+using chrono::nanoseconds;
+using chrono::steady_clock;
+
+// Trace of the run on a monotonic nanosecond clock. Every thread appends the
+// spans it closes to its own buffer, so recording takes no lock, and spans of
+// one thread nest by time (run > part > machine). After the run the buffers
+// give latency statistics per span name and a Chrome trace-event file
+// (chrome://tracing or ui.perfetto.dev).
+struct TraceEvent
+{
+    const char *name;
+    size_t machine;
+    uint64_t begin, end; // ns since the profiler started
+};
+
+struct Profiler
+{
+    constexpr static const size_t NO_MACHINE = numeric_limits<size_t>::max();
+
+    struct ThreadBuffer
+    {
+        size_t tid = 0;
+        vector<TraceEvent> events;
+        size_t dropped = 0; // spans over max_events
+    };
+
+    const steady_clock::time_point t0 = steady_clock::now();
+    mutex m; // only taken when a thread records its first span
+    vector<unique_ptr<ThreadBuffer>> buffers;
+    size_t max_events = 0; // per thread, 0 for no limit; set before any thread records
+
+    static Profiler &get()
+    {
+        static Profiler p;
+        return p;
+    }
+
+    uint64_t now() const
+    {
+        return duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+    }
+
+    ThreadBuffer &local()
+    {
+        thread_local ThreadBuffer *buf = nullptr;
+        if (!buf)
+        {
+            lock_guard<mutex> lock(m);
+            buffers.push_back(make_unique<ThreadBuffer>());
+            buf = buffers.back().get();
+            buf->tid = buffers.size() - 1;
+        }
+        return *buf;
+    }
+
+    void record(const char *name, const size_t machine, const uint64_t begin, const uint64_t end)
+    {
+        auto &buf = local();
+        if (max_events && buf.events.size() >= max_events)
+            ++buf.dropped;
+        else
+            buf.events.push_back({name, machine, begin, end});
+    }
+
+    size_t dropped() const
+    {
+        size_t n = 0;
+        for (const auto &b : buffers)
+            n += b->dropped;
+        return n;
+    }
+
+    // all spans with this name, slowest first; call after all threads joined
+    vector<TraceEvent> spans(const char *name) const
+    {
+        vector<TraceEvent> s;
+        for (const auto &b : buffers)
+            for (const auto &e : b->events)
+                if (strcmp(e.name, name) == 0)
+                    s.push_back(e);
+
+        sort(s.begin(), s.end(), [](const auto &a, const auto &b)
+             { return a.end - a.begin > b.end - b.begin; });
+        return s;
+    }
+
+    // p50/p99/max, the slowest machines and a log2 histogram of the span durations
+    void report(ostream &os, const char *name) const
+    {
+        const auto s = spans(name);
+        if (s.empty())
+            return;
+
+        const auto dur = [](const TraceEvent &e)
+        { return (e.end - e.begin) * 1e-6; };
+        const auto pct = [&](const double p)
+        { return dur(s[min(s.size() - 1, static_cast<size_t>((1.0 - p) * s.size()))]); };
+
+        os << name << ": " << s.size() << " spans, p50 " << pct(0.5) << "(ms), p99 " << pct(0.99)
+           << "(ms), max " << dur(s.front()) << "(ms)\n";
+        if (const auto n = dropped())
+            os << "  " << n << " spans over the limit not recorded\n";
+
+        os << "  slowest:";
+        for (size_t k = 0; k < s.size() && k < 5; ++k)
+            os << " #" << s[k].machine << " " << dur(s[k]) << "(ms)";
+        os << "\n";
+
+        // bucket b holds durations in [2^(b-1), 2^b) us
+        array<size_t, 64> hist{};
+        size_t first = hist.size(), last = 0;
+        for (const auto &e : s)
+        {
+            const size_t b = bit_width((e.end - e.begin) / 1000);
+            ++hist[b];
+            first = min(first, b);
+            last = max(last, b);
+        }
+        for (size_t b = first; b <= last; ++b)
+            os << "  < " << (uint64_t(1) << b) << "(us): " << hist[b] << "\n";
+    }
+
+    int write_chrome_trace(const string &fname) const
+    {
+        ofstream f(fname);
+        if (!f.is_open())
+            return -1;
 
-// build a clock to measure performance time
-struct PerfClock {
+        f << fixed << setprecision(3) << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto &b : buffers)
+            for (const auto &e : b->events)
+            {
+                f << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << b->tid
+                  << ",\"ts\":" << e.begin * 1e-3 << ",\"dur\":" << (e.end - e.begin) * 1e-3;
+                if (e.machine != NO_MACHINE)
+                    f << ",\"args\":{\"machine\":" << e.machine << "}";
+                f << "}";
+                first = false;
+            }
+        f << "\n]}\n";
+
+        return f ? 0 : -1;
+    }
+};
 
-    time_point<system_clock> t_start;
+// records a span from construction to stop() or destruction
+struct TraceScope
+{
+    const char *name;
+    size_t machine;
+    uint64_t begin, end = 0;
 
-    void start() {
-        t_start = system_clock::now();
+    explicit TraceScope(const char *name, const size_t machine = Profiler::NO_MACHINE)
+        : name{name}, machine{machine}, begin{Profiler::get().now()}
+    {
     }
 
-    milliseconds get_lap() {
-        auto t2 = system_clock::now();
-        return duration_cast<milliseconds>(t2 - t_start);
+    ~TraceScope() { stop(); }
+
+    void stop()
+    {
+        if (end)
+            return;
+        end = Profiler::get().now();
+        Profiler::get().record(name, machine, begin, end);
     }
 
+    // elapsed time, up to stop() if stopped
+    double ms() const
+    {
+        return ((end ? end : Profiler::get().now()) - begin) * 1e-6;
+    }
 };
 
 // The manual describes one machine per line.
@@ -57,318 +234,2598 @@ enum DataIndicators
 // So, an indicator light diagram like [.##.] means that the machine has four indicator lights which are initially off
 // and that the goal is to simultaneously configure the first light to be off,
 // the second light to be on, the third to be on, and the fourth to be off.
-constexpr const size_t MAX_LIGHTS = 16;
+// The solvers work on the narrowest mask that holds all lights of a machine,
+// see solve_lights.
+constexpr const size_t MAX_LIGHTS = 128;
 using LightVec = bitset<MAX_LIGHTS>;
 
 constexpr const char LIGHT_OFF = '.',
                      LIGHT_ON = '#';
 
-LightVec to_LightVec(const string &light_str)
+constexpr const size_t MAX_BUTTONS = 64;
+
+// A machine as the solvers see it, there is one joltage value per light.
+struct MachineView
+{
+    LightVec target;
+    span<const LightVec> buttons;
+    span<const joltage_t> jolt;
+};
+
+// One machine as parsed, fixed size so parsing never allocates.
+struct MachineRecord
 {
-    LightVec b(0);
+    size_t line = 0;
+    size_t n_lights = 0,
+           n_buttons = 0;
+    LightVec target;
+    array<LightVec, MAX_BUTTONS> buttons;
+    array<joltage_t, MAX_LIGHTS> jolt;
+
+    MachineView view() const
+    {
+        return {target, span(buttons.data(), n_buttons), span(jolt.data(), n_lights)};
+    }
+};
+
+// yields the lines of a file or stdin as views, without copying a mapped file
+struct LineSource
+{
+    constexpr static const size_t STDIN_BUFFER = size_t(1) << 20;
+
+    const char *data = nullptr;
+    size_t size = 0,
+           pos = 0;
+    void *map = MAP_FAILED;
+    int fd = -1;
+    vector<char> buf; // only for stdin
+    bool eof = true;
 
-    for (auto i = 0; i < light_str.size() && i < b.size(); ++i)
+    int open(const string &fname)
     {
-        switch (light_str[i])
+        if (fname == "-")
         {
-        case LIGHT_OFF:
-            // b[light_str.size() - i - 1] = false;
-            b[i] = false;
-            break;
-        case LIGHT_ON:
-            // b[light_str.size() - i - 1] = true;
-            b[i] = true;
-            break;
-        default:
-            ostringstream oss;
-            oss << "Invalid argument: '{}'" << light_str;
-            throw invalid_argument(oss.str());
+            fd = STDIN_FILENO;
+            buf.resize(STDIN_BUFFER);
+            data = buf.data();
+            eof = false;
+            return 0;
         }
+
+        fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0)
+            return -1;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            return -1;
+        size = st.st_size;
+        if (size == 0)
+            return 0;
+
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            return -1;
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(map);
+
+        return 0;
     }
-    return b;
-}
 
-size_t read_str_between_indicators(const string &line, string &substr, const DataIndicators &start, const DataIndicators &end, const size_t &start_pos = 0)
-{
-    substr.clear();
+    ~LineSource()
+    {
+        if (map != MAP_FAILED)
+            munmap(map, size);
+        if (fd > STDIN_FILENO)
+            close(fd);
+    }
 
-    // search start and end
-    const auto s = line.find(start, start_pos);
-    if (s >= line.length())
+    // gives the mapped pages before the current line back to the kernel, so a
+    // single pass over a large file keeps a bounded resident size; the lines
+    // returned so far are no longer valid and rewind() reads them from the file
+    void release_read()
     {
-        // cout << "Could not find start sign " << start << " in " << line << " starting from " << start_pos << " \n";
-        return line.length();
+        if (map == MAP_FAILED)
+            return;
+        const size_t page = sysconf(_SC_PAGESIZE),
+                     n = pos / page * page;
+        if (n > 0)
+            madvise(map, n, MADV_DONTNEED);
     }
 
-    const auto e = line.find(end, s);
-    if (e >= line.length() || s >= e)
+    // back to the first line, stdin can not be read twice
+    int rewind()
     {
-        // cout << "Could not find end sign " << end << " in " << line << " starting from " << s << " \n";
-        return line.length();
+        if (fd == STDIN_FILENO)
+            return -1;
+        pos = 0;
+        return 0;
     }
 
-    // extract
-    substr = line.substr(s + 1, e - s - 1);
+    // refill the stdin buffer, the unread rest is moved to the front
+    bool refill()
+    {
+        if (eof)
+            return false;
+
+        const size_t rest = size - pos;
+        if (rest == buf.size())
+            return false; // line longer than the buffer
 
-    return e;
-}
+        memmove(buf.data(), buf.data() + pos, rest);
+        pos = 0;
+        size = rest;
 
-template <typename T>
-int str_to_vec(vector<T> &buf, const string &line, const char sep = DataIndicators::LIST_SEP)
-{
-    buf.clear();
+        const auto n = read(fd, buf.data() + size, buf.size() - size);
+        if (n <= 0)
+            eof = true;
+        else
+            size += n;
+
+        return n > 0;
+    }
+
+    bool next(string_view &line)
+    {
+        while (true)
+        {
+            const auto nl = static_cast<const char *>(memchr(data + pos, '\n', size - pos));
+            if (nl)
+            {
+                line = string_view(data + pos, nl - (data + pos));
+                pos = nl - data + 1;
+                return true;
+            }
+            if (!refill())
+                break;
+        }
+
+        // last line without newline
+        if (pos < size)
+        {
+            line = string_view(data + pos, size - pos);
+            pos = size;
+            return true;
+        }
+        return false;
+    }
+};
 
-    for (size_t s = 0; s < line.length();)
+// reads a list of numbers like "1,3,4" up to the closing sign
+template <typename F>
+const char *parse_list(const char *p, const char *end, const char close, F &&emit)
+{
+    while (p < end && *p != close)
     {
+        if (*p == DataIndicators::LIST_SEP || *p == ' ')
+        {
+            ++p;
+            continue;
+        }
+
+        size_t v = 0;
+        const auto [q, ec] = from_chars(p, end, v);
+        if (ec != errc{} || !emit(v))
+            return nullptr;
+        p = q;
+    }
 
-        // skip if s is seperator
-        if (line[s] == sep)
-            ++s;
+    return p < end ? p + 1 : nullptr;
+}
 
-        auto e = line.find(sep, s);
-        if (e > line.length())
-            e = line.length();
+bool parse_machine(const string_view line, MachineRecord &m)
+{
+    const char *p = line.data(),
+               *end = line.data() + line.size();
+
+    m.n_lights = 0;
+    m.n_buttons = 0;
+    m.target.reset();
+
+    // light diagram
+    while (p < end && *p != DataIndicators::LIGHT_DIAGRAM_BEGIN)
+        ++p;
+    if (p++ >= end)
+        return false;
+    for (; p < end && *p != DataIndicators::LIGHT_DIAGRAM_END; ++p)
+    {
+        if (m.n_lights >= MAX_LIGHTS || (*p != LIGHT_ON && *p != LIGHT_OFF))
+            return false;
+        m.target[m.n_lights++] = (*p == LIGHT_ON);
+    }
+    if (p++ >= end)
+        return false;
 
-        buf.push_back(static_cast<T>(stol(line.substr(s, e - s))));
-        s = e;
+    // button wirings, then joltage
+    while (p < end)
+    {
+        switch (*p)
+        {
+        case DataIndicators::BUTTON_WIRING_BEGIN:
+            if (m.n_buttons >= MAX_BUTTONS)
+                return false;
+            m.buttons[m.n_buttons].reset();
+            p = parse_list(p + 1, end, DataIndicators::BUTTON_WIRING_END, [&](const size_t i)
+                           { return i < m.n_lights && (m.buttons[m.n_buttons][i] = true); });
+            if (!p)
+                return false;
+            ++m.n_buttons;
+            break;
+        case DataIndicators::JOLTAGE_REQU_BEGIN:
+        {
+            size_t n_jolt = 0;
+            p = parse_list(p + 1, end, DataIndicators::JOLTAGE_REQU_END, [&](const size_t v)
+                           {
+                if (n_jolt >= m.n_lights)
+                    return false;
+                m.jolt[n_jolt++] = static_cast<joltage_t>(v);
+                return true; });
+            return p && n_jolt == m.n_lights;
+        }
+        default:
+            ++p;
+        }
     }
 
-    return buf.size();
+    return false;
 }
 
-int read_input(const string &fname, vector<LightVec> &lights, vector<vector<iVec>> &buts, vector<joltVec> &jolt)
+// All machines in a few flat arrays carved out of a single allocation:
+//     targets[i]                                          target of machine i
+//     buttons[button_offset[i] .. button_offset[i + 1])   its button masks
+//     jolt[jolt_offset[i] .. jolt_offset[i + 1])          its joltage
+// Machines are reordered by index (see order_by_cost), never copied.
+struct MachineSet
 {
-    ifstream rfile;
+    unique_ptr<byte[]> arena;
+    span<LightVec> targets, buttons;
+    span<size_t> button_offset, jolt_offset;
+    span<joltage_t> jolt;
+    size_t n = 0;
+
+    template <typename T>
+    static span<T> carve(byte *&p, const size_t count)
+    {
+        const auto a = reinterpret_cast<uintptr_t>(p);
+        p += (alignof(T) - a % alignof(T)) % alignof(T);
 
-    rfile.open(fname);
+        T *t = reinterpret_cast<T *>(p);
+        uninitialized_value_construct_n(t, count);
+        p += count * sizeof(T);
+        return {t, count};
+    }
 
-    if (!rfile.is_open())
+    void allocate(const size_t n_machines, const size_t n_buttons, const size_t n_jolt)
     {
-        cout << "please provide filename\n";
-        return -1;
+        const size_t bytes = (n_machines + n_buttons) * sizeof(LightVec) +
+                             2 * (n_machines + 1) * sizeof(size_t) +
+                             n_jolt * sizeof(joltage_t) +
+                             5 * alignof(max_align_t);
+
+        arena = make_unique<byte[]>(bytes);
+        byte *p = arena.get();
+        targets = carve<LightVec>(p, n_machines);
+        buttons = carve<LightVec>(p, n_buttons);
+        button_offset = carve<size_t>(p, n_machines + 1);
+        jolt_offset = carve<size_t>(p, n_machines + 1);
+        jolt = carve<joltage_t>(p, n_jolt);
+        n = 0;
     }
 
-    string line,
-        substr;
-    while (getline(rfile, line))
+    void push_back(const MachineRecord &m)
     {
-        // add new line to buffers
-        lights.push_back({});
-        buts.push_back({});
-        jolt.push_back({});
+        targets[n] = m.target;
+        copy_n(m.buttons.begin(), m.n_buttons, buttons.begin() + button_offset[n]);
+        copy_n(m.jolt.begin(), m.n_lights, jolt.begin() + jolt_offset[n]);
+        button_offset[n + 1] = button_offset[n] + m.n_buttons;
+        jolt_offset[n + 1] = jolt_offset[n] + m.n_lights;
+        ++n;
+    }
 
-        // extract light status
-        auto e = read_str_between_indicators(line, substr, DataIndicators::LIGHT_DIAGRAM_BEGIN, DataIndicators::LIGHT_DIAGRAM_END);
-        if (e >= line.length())
-            return -1;
-        lights.back() = to_LightVec(substr);
+    size_t size() const { return n; }
 
-        // extract button wirings
-        auto e_but = e;
-        while (true)
-        {
-            e_but = read_str_between_indicators(line, substr, DataIndicators::BUTTON_WIRING_BEGIN, DataIndicators::BUTTON_WIRING_END, e_but);
-            if (e_but >= line.length())
-                break;
+    MachineView operator[](const size_t i) const
+    {
+        return {targets[i],
+                buttons.subspan(button_offset[i], button_offset[i + 1] - button_offset[i]),
+                jolt.subspan(jolt_offset[i], jolt_offset[i + 1] - jolt_offset[i])};
+    }
+};
 
-            iVec butbuf;
-            str_to_vec(butbuf, substr);
-            buts.back().push_back(butbuf);
-        }
+int read_input(const string &fname, MachineSet &machines)
+{
+    LineSource src;
+    if (src.open(fname))
+    {
+        cout << "please provide filename\n";
+        return -1;
+    }
 
-        // extract joltage
-        e = read_str_between_indicators(line, substr, DataIndicators::JOLTAGE_REQU_BEGIN, DataIndicators::JOLTAGE_REQU_END, e);
-        if (e >= line.length())
+    // the first pass only counts, so the arena gets its exact size
+    MachineRecord m;
+    string_view line;
+    size_t n_machines = 0,
+           n_buttons = 0,
+           n_jolt = 0;
+    while (src.next(line))
+    {
+        if (line.empty())
+            continue;
+        if (!parse_machine(line, m))
             return -1;
-        str_to_vec(jolt.back(), substr);
+        ++n_machines;
+        n_buttons += m.n_buttons;
+        n_jolt += m.n_lights;
     }
 
+    if (src.rewind())
+        return -1;
+
+    machines.allocate(n_machines, n_buttons, n_jolt);
+    while (src.next(line))
+        if (!line.empty() && parse_machine(line, m))
+            machines.push_back(m);
+
     return 0;
 }
 
-void sort_by_number_of_lights(vector<LightVec> &lights, vector<vector<iVec>> &buts, vector<joltVec> &jolt)
+using jmat_t = long long;
+
+void normalize_row(vector<jmat_t> &row)
 {
-    // build index
-    vector<size_t> argi(lights.size());
-    iota(argi.begin(), argi.end(), 0);
+    jmat_t g = 0;
+    for (const auto &v : row)
+        g = gcd(g, v);
+    if (g > 1)
+        for (auto &v : row)
+            v /= g;
+}
+
+// Fraction free gauss jordan elimination of m = [A | rhs] (n_cols columns of
+// A), the smallest pivot first: while the pivots are +-1 no row is scaled, so
+// the pivot buttons stay integers whenever the free buttons are. Row k < rank
+// has its pivot in pivot_col[k], the rows below are zero on the left side.
+size_t reduce_joltage_matrix(vector<vector<jmat_t>> &m, const size_t n_cols, vector<size_t> &pivot_col)
+{
+    const size_t n_rows = m.size();
+    pivot_col.clear();
+    vector<bool> is_pivot(n_cols, false);
+    size_t rank = 0;
+    while (rank < n_rows)
+    {
+        // a +-1 can not be beaten, take the first one
+        size_t r = n_rows, c = n_cols;
+        for (size_t r2 = rank; r2 < n_rows && (c == n_cols || abs(m[r][c]) != 1); ++r2)
+            for (size_t c2 = 0; c2 < n_cols; ++c2)
+                if (!is_pivot[c2] && m[r2][c2] != 0 && (c == n_cols || abs(m[r2][c2]) < abs(m[r][c])))
+                {
+                    r = r2;
+                    c = c2;
+                    if (abs(m[r][c]) == 1)
+                        break;
+                }
+        if (c == n_cols)
+            break;
+
+        swap(m[r], m[rank]);
+        if (m[rank][c] < 0)
+            for (auto &v : m[rank])
+                v = -v;
 
-    // sort by number of lights to switch on
-    sort(argi.begin(), argi.end(), [&lights](const auto &a, const auto &b)
-         { return lights[a].size() < lights[b].size(); });
+        for (size_t r2 = 0; r2 < n_rows; ++r2)
+        {
+            if (r2 == rank || m[r2][c] == 0)
+                continue;
+            const auto f1 = m[rank][c], f2 = m[r2][c];
+            for (size_t k = 0; k < m[r2].size(); ++k)
+                m[r2][k] = m[r2][k] * f1 - m[rank][k] * f2;
+            // keeps the numbers small, rows that were not scaled hardly grow
+            if (f1 != 1)
+                normalize_row(m[r2]);
+        }
+
+        pivot_col.push_back(c);
+        is_pivot[c] = true;
+        ++rank;
+    }
+    return rank;
+}
 
-    vector<LightVec> temp_light(argi.size());
-    vector<vector<iVec>> temp_buts(argi.size());
-    vector<joltVec> temp_jolt(argi.size());
+// buttons of a machine that are not fixed by its counters, n_but - rank(A)
+size_t free_buttons(const MachineView &m)
+{
+    const size_t n_but = m.buttons.size();
 
-    for (size_t i = 0; i < argi.size(); ++i)
+    // reused, this runs for every machine before solving starts
+    thread_local vector<vector<jmat_t>> a;
+    thread_local vector<size_t> pivot_col;
+    a.resize(m.jolt.size());
+    for (size_t i = 0; i < a.size(); ++i)
     {
-        const auto &ia = argi[i];
-        temp_light[i] = lights[ia];
-        temp_buts[i] = buts[ia];
-        temp_jolt[i] = jolt[ia];
+        a[i].resize(n_but);
+        for (size_t j = 0; j < n_but; ++j)
+            a[i][j] = m.buttons[j][i];
     }
 
-    lights = move(temp_light);
-    buts = move(temp_buts);
-    jolt = move(temp_jolt);
+    return n_but - reduce_joltage_matrix(a, n_but, pivot_col);
+}
+
+// Rough estimate how expensive a machine is to solve: the solvers enumerate
+// the buttons that are not fixed by the counters, each bounded by the
+// joltage. Returned as log2 so it can not overflow.
+double estimate_cost(const MachineView &m)
+{
+    const size_t n_but = m.buttons.size();
+    const double n_free = free_buttons(m);
+    const double max_jolt = m.jolt.empty() ? 0 : *max_element(m.jolt.begin(), m.jolt.end());
+
+    return log2(n_but + 1.0) + n_free * log2(max_jolt + 2.0);
 }
 
-LightVec light_indices_to_bitset(const iVec &i_vec)
+// machine indices, most expensive first, so no big machine is left for the end
+vector<size_t> order_by_cost(const MachineSet &machines)
 {
-    // [.##.] (3) (1,3) (2) (2,3) (0,2) (0,1) {3,5,4,7}
-    //  .##. -> 0110
-    //   (3) -> 1000
-    //   XOR -> 1110
-    // (0,2) -> 0101
-    //   XOR -> 1011
-    //   (3) -> 1000
-    //   XOR -> 0011
-    // ---------------
-    //  .##. -> 0110
-    // (0,2) -> 0101
-    //   XOR -> 0011
+    vector<double> cost(machines.size());
+    for (size_t i = 0; i < machines.size(); ++i)
+        cost[i] = estimate_cost(machines[i]);
+
+    vector<size_t> argi(machines.size());
+    iota(argi.begin(), argi.end(), 0);
+
+    stable_sort(argi.begin(), argi.end(), [&cost](const auto &a, const auto &b)
+                { return cost[a] > cost[b]; });
 
-    LightVec b(0);
+    return argi;
+}
 
-    for (const auto &i : i_vec)
+// Runs solve(machine, worker) for every machine in order on all hardware threads.
+// The ordered machines are dealt round robin into one slice per worker, so every
+// worker starts with a big machine. A worker takes machines from the front of its
+// own slice and, once that is empty, steals from the back of the other slices.
+// front and back of a slice are packed into one atomic word, so both ends are
+// taken with a single compare and swap and no locks.
+struct MachineScheduler
+{
+    struct Slice
     {
-        if (i < b.size())
+        atomic<uint64_t> range{0}; // front << 32 | back
+
+        static uint64_t pack(const uint64_t f, const uint64_t b) { return (f << 32) | b; }
+
+        bool pop_front(size_t &task)
+        {
+            auto r = range.load();
+            while (true)
+            {
+                const auto f = r >> 32, b = r & 0xffffffff;
+                if (f >= b)
+                    return false;
+                if (range.compare_exchange_weak(r, pack(f + 1, b)))
+                {
+                    task = f;
+                    return true;
+                }
+            }
+        }
+
+        bool steal_back(size_t &task)
         {
-            b[i] = true;
+            auto r = range.load();
+            while (true)
+            {
+                const auto f = r >> 32, b = r & 0xffffffff;
+                if (f >= b)
+                    return false;
+                if (range.compare_exchange_weak(r, pack(f, b - 1)))
+                {
+                    task = b - 1;
+                    return true;
+                }
+            }
         }
+    };
+
+    size_t n_workers;
+    vector<size_t> tasks;
+    vector<Slice> slices;
+
+    explicit MachineScheduler(const size_t n_workers = thread::hardware_concurrency())
+        : n_workers{max<size_t>(1, n_workers)}, slices(this->n_workers)
+    {
     }
 
-    // cout << b << "\n";
+    template <typename F>
+    void run(const vector<size_t> &order, F &&solve)
+    {
+        // deal round robin: slice w holds order[w], order[w + n_workers], ...
+        tasks.resize(order.size());
+        size_t pos = 0;
+        for (size_t w = 0; w < n_workers; ++w)
+        {
+            const size_t front = pos;
+            for (size_t k = w; k < order.size(); k += n_workers)
+                tasks[pos++] = order[k];
+            slices[w].range = Slice::pack(front, pos);
+        }
 
-    return b;
-}
+        const auto worker = [&](const size_t w)
+        {
+            size_t t;
+            while (slices[w].pop_front(t))
+                solve(tasks[t], w);
+
+            for (size_t v = 1; v < n_workers; ++v)
+                while (slices[(w + v) % n_workers].steal_back(t))
+                    solve(tasks[t], w);
+        };
+
+        vector<thread> pool;
+        for (size_t w = 1; w < n_workers; ++w)
+            pool.emplace_back(worker, w);
+        worker(0);
+        for (auto &t : pool)
+            t.join();
+    }
+};
 
-size_t switch_buttons(const LightVec lights, const LightVec &target, const vector<LightVec> &bitmasks, unordered_map<LightVec, size_t> &ls_cache, const size_t current_best, const size_t d = 1)
+// Light masks of a machine: uint16_t, uint32_t and uint64_t for up to 64
+// lights, so XOR is a single register operation, and WideMask for more.
+template <size_t N>
+struct WideMask
 {
-    if (bitmasks.size() <= 1)
+    array<uint64_t, N> w{};
+
+    WideMask &operator^=(const WideMask &o)
     {
-        // TODO: check if last light realy solves
-        return d;
+        for (size_t k = 0; k < N; ++k)
+            w[k] ^= o.w[k];
+        return *this;
     }
-    else if (current_best < d)
+
+    bool operator==(const WideMask &) const = default;
+};
+
+template <typename M>
+constexpr size_t mask_bits = sizeof(M) * 8;
+
+template <typename M>
+M to_mask(const LightVec &b)
+{
+    const LightVec word(numeric_limits<uint64_t>::max());
+
+    if constexpr (is_unsigned_v<M>)
+        return static_cast<M>((b & word).to_ullong());
+    else
     {
-        // check if we stepped over current best
-        return d;
+        M m;
+        for (size_t k = 0; k < m.w.size(); ++k)
+            m.w[k] = ((b >> (64 * k)) & word).to_ullong();
+        return m;
     }
+}
 
-    vector<LightVec> bm;
-    bm.reserve(bitmasks.size() - 1);
-    auto new_d = d + bitmasks.size();
-    for (const auto &b : bitmasks)
+template <typename M>
+bool mask_empty(const M &m)
+{
+    if constexpr (is_unsigned_v<M>)
+        return m == 0;
+    else
+        return all_of(m.w.begin(), m.w.end(), [](const auto &w)
+                      { return w == 0; });
+}
+
+// index of the highest light that is on, m must not be empty
+template <typename M>
+size_t mask_highest(const M &m)
+{
+    if constexpr (is_unsigned_v<M>)
+        return bit_width(m) - 1;
+    else
     {
-        auto new_light = lights ^ b;
+        size_t k = m.w.size() - 1;
+        while (m.w[k] == 0)
+            --k;
+        return 64 * k + bit_width(m.w[k]) - 1;
+    }
+}
 
-        if (new_light == target)
-        {
-            ls_cache.insert(make_pair(new_light, d));
-            return d;
-        }
-        else if (ls_cache.count(new_light) > 0)
-        {
-            // check if there is a better combination to reach this light state
-            // or update
-            if (ls_cache[new_light] <= d)
-                continue;
-            else
-                ls_cache[new_light] = d;
-        }
-        else
+// Pressing a button twice is the same as not pressing it, so toggling lights is
+// a linear system over GF(2) in which every button is a vector of lights.
+// Gaussian elimination of the button vectors gives a basis of the reachable
+// patterns, keyed by their highest light and remembering which buttons they
+// combine. Buttons that reduce to zero span the null space, i.e. button sets
+// that do not change any light. The target reduced by the basis gives a
+// particular solution, the minimum is found by searching the null space.
+using ButtonMask = uint64_t;
+constexpr const size_t NO_SOLUTION = numeric_limits<size_t>::max();
+
+template <typename M>
+size_t solve_lights_gf2(const M &target, const span<const M> bitmasks)
+{
+    const size_t n_but = bitmasks.size();
+    if (n_but > MAX_BUTTONS)
+    {
+        ostringstream oss;
+        oss << "Invalid argument: " << n_but << " buttons, max. " << MAX_BUTTONS;
+        throw invalid_argument(oss.str());
+    }
+
+    // combo[p] == 0 marks an empty basis slot, a basis vector always combines a button
+    array<M, mask_bits<M>> basis{};
+    array<ButtonMask, mask_bits<M>> combo{};
+    array<ButtonMask, MAX_BUTTONS> null_space{};
+    size_t n_free = 0;
+
+    for (size_t j = 0; j < n_but; ++j)
+    {
+        M v = bitmasks[j];
+        ButtonMask c = ButtonMask(1) << j;
+        while (!mask_empty(v))
         {
-            ls_cache.insert(make_pair(new_light, d));
+            const auto p = mask_highest(v);
+            if (!combo[p])
+            {
+                basis[p] = v;
+                combo[p] = c;
+                break;
+            }
+            v ^= basis[p];
+            c ^= combo[p];
         }
 
-        // copy and remove current b
-        bm.clear();
-        for (const auto &_b : bitmasks)
-            if (_b != b)
-                bm.push_back(_b);
+        if (mask_empty(v))
+            null_space[n_free++] = c;
+    }
+
+    // particular solution, fails if the target is not reachable
+    M v = target;
+    ButtonMask particular = 0;
+    while (!mask_empty(v))
+    {
+        const auto p = mask_highest(v);
+        if (!combo[p])
+            return NO_SOLUTION;
+        v ^= basis[p];
+        particular ^= combo[p];
+    }
+
+    // every solution presses at least as many buttons as null space vectors are
+    // selected, so enumerate selections by increasing popcount and stop once it
+    // can not beat the best
+    size_t best = popcount(particular);
+    for (size_t k = 1; k <= n_free && k < best; ++k)
+    {
+        // iterate all n_free-bit masks with k bits set (Gosper's hack)
+        for (ButtonMask sel = (ButtonMask(1) << k) - 1; !(sel >> n_free);)
+        {
+            ButtonMask x = particular;
+            for (ButtonMask s = sel; s; s &= s - 1)
+                x ^= null_space[countr_zero(s)];
 
-        auto _d = switch_buttons(new_light, target, bm, ls_cache, new_d, d + 1);
+            best = min(best, static_cast<size_t>(popcount(x)));
 
-        if (_d < new_d)
-            new_d = _d;
+            const ButtonMask c = sel & -sel,
+                             r = sel + c;
+            sel = (((r ^ sel) >> 2) / c) | r;
+        }
     }
 
-    return new_d;
+    return best;
 }
 
-size_t switch_buttons(const vector<LightVec> &lights, const vector<vector<iVec>> &buts)
+// With up to BFS_MAX_LIGHTS lights a machine has at most 2^BFS_MAX_LIGHTS states,
+// so a breadth first search over all of them fits into flat arrays indexed by
+// the raw state.
+// The buffers are allocated once and reused for every machine: instead of
+// clearing dist, a state counts as visited only if its stamp matches the
+// current search.
+using LightState = uint32_t;
+constexpr const size_t BFS_MAX_LIGHTS = 16;
+constexpr const size_t N_LIGHT_STATES = size_t(1) << BFS_MAX_LIGHTS;
+
+struct LightBfs
 {
-    vector<vector<LightVec>> bitmasks(buts.size());
+    vector<uint8_t> dist = vector<uint8_t>(N_LIGHT_STATES);
+    vector<uint32_t> stamp = vector<uint32_t>(N_LIGHT_STATES, 0);
+    vector<LightState> frontier = vector<LightState>(N_LIGHT_STATES); // ring buffer
+    vector<LightState> masks;
+    uint32_t current = 0;
+
+    bool visited(const LightState s) const { return stamp[s] == current; }
 
-    // map light switch indices to bitmasks
-    for (auto i = 0; i < buts.size(); ++i)
+    void visit(const LightState s, const uint8_t d)
     {
-        bitmasks[i].reserve(buts[i].size());
-        for (const auto &ind : buts[i])
-            bitmasks[i].push_back(light_indices_to_bitset(ind));
+        stamp[s] = current;
+        dist[s] = d;
     }
 
-    // try to push buttons to switch all lights on
-    size_t num_push = 0;
-    for (size_t i = 0; i < lights.size(); ++i)
+    size_t solve(const uint16_t target, const span<const uint16_t> bitmasks)
     {
-        unordered_map<LightVec, size_t> ls_cache;
-        num_push += switch_buttons(LightVec(0), lights[i], bitmasks[i], ls_cache, bitmasks[i].size());
-    }
+        masks.assign(bitmasks.begin(), bitmasks.end());
 
-    return num_push;
-}
+        // new search, wrap around resets all stamps
+        if (++current == 0)
+        {
+            fill(stamp.begin(), stamp.end(), 0);
+            current = 1;
+        }
 
-// PART 2
+        const LightState t = target;
+        constexpr const size_t ring = N_LIGHT_STATES - 1;
+        size_t head = 0, tail = 0;
+
+        visit(0, 0);
+        frontier[tail++ & ring] = 0;
 
-size_t get_joltage_button_press(vector<joltVec> &joltage, const vector<vector<iVec>> &buts)
+        while (head != tail)
+        {
+            const auto s = frontier[head++ & ring];
+            if (s == t)
+                return dist[s];
+
+            for (const auto &m : masks)
+            {
+                const auto n = s ^ m;
+                if (visited(n))
+                    continue;
+                visit(n, dist[s] + 1);
+                frontier[tail++ & ring] = n;
+            }
+        }
+
+        return NO_SOLUTION;
+    }
+};
+
+// Meet in the middle for machines with many buttons and too many lights for
+// the BFS: the XOR sums of all subsets of the first half of the buttons go into
+// a flat open addressing table with the fewest presses per sum, then every
+// subset sum s of the second half looks up target ^ s. Both halves are
+// enumerated in Gray code order, so every step is a single XOR, and 2^B work
+// becomes about 2 * 2^(B/2) time and 2^(B/2) memory.
+// Every worker keeps its own table, so the first half is capped at
+// MITM_MAX_TABLE_BITS buttons (2^21 slots) and larger machines shift the work
+// to the second half. Machines with more than MITM_MAX_BUTTONS use GF(2).
+constexpr const size_t MITM_MAX_BUTTONS = 48;
+constexpr const size_t MITM_MAX_TABLE_BITS = 20;
+
+template <typename M>
+uint64_t mask_hash(const M &m)
 {
-    size_t n_push = 0;
+    constexpr const uint64_t golden = 0x9e3779b97f4a7c15ull;
 
-    return n_push;
+    if constexpr (is_unsigned_v<M>)
+        return static_cast<uint64_t>(m) * golden;
+    else
+    {
+        uint64_t h = 0;
+        for (const auto &w : m.w)
+            h = (h ^ w) * golden;
+        return h;
+    }
 }
 
-int main(int argc, char *argv[])
+// reused by every machine of a thread, only the cost array is reset
+template <typename M>
+struct MitmTable
 {
-    PerfClock clock;
-    vector<LightVec> lights;
-    vector<vector<iVec>> buttons;
-    vector<joltVec> joltage;
-    string fname;
+    constexpr static const uint8_t EMPTY = 0xff;
 
-    // ============== READ INPUT ==============
-    if (argc >= 2)
+    vector<M> keys;
+    vector<uint8_t> cost;
+    size_t bits = 1;
+
+    // room for n sums at a load factor of at most 1/2
+    void reset(const size_t n)
     {
-        fname = argv[1];
-        cout << "read file " << fname << "\n";
+        bits = bit_width(2 * n - 1);
+        const size_t cap = size_t(1) << bits;
+        if (keys.size() < cap)
+        {
+            keys.resize(cap);
+            cost.resize(cap);
+        }
+        fill_n(cost.begin(), cap, EMPTY);
     }
-    else
-        return -1;
 
-        clock.start();
-    if (read_input(fname, lights, buttons, joltage))
+    size_t slot(const M &m) const { return mask_hash(m) >> (64 - bits); }
+
+    void insert_min(const M &m, const uint8_t c)
     {
-        cout << "cannot read file " << fname << "\n";
-        return -1;
+        const size_t ring = (size_t(1) << bits) - 1;
+        for (size_t s = slot(m);; s = (s + 1) & ring)
+        {
+            if (cost[s] == EMPTY)
+            {
+                keys[s] = m;
+                cost[s] = c;
+                return;
+            }
+            if (keys[s] == m)
+            {
+                cost[s] = min(cost[s], c);
+                return;
+            }
+        }
     }
 
-    cout << "read " << lights.size() << " lines in " << clock.get_lap().count() << "(ms)\n";
+    uint8_t find(const M &m) const
+    {
+        const size_t ring = (size_t(1) << bits) - 1;
+        for (size_t s = slot(m); cost[s] != EMPTY; s = (s + 1) & ring)
+            if (keys[s] == m)
+                return cost[s];
+        return EMPTY;
+    }
+};
 
-    // ============== PART 1 ==============
+template <typename M>
+size_t solve_lights_mitm(const M &target, const span<const M> bitmasks)
+{
+    const size_t n_but = bitmasks.size();
+    if (n_but > MITM_MAX_BUTTONS)
+    {
+        ostringstream oss;
+        oss << "Invalid argument: " << n_but << " buttons, max. " << MITM_MAX_BUTTONS;
+        throw invalid_argument(oss.str());
+    }
 
-    cout << "=============== PART 1 ===============\n";
-    clock.start();
-    auto min_push = switch_buttons(lights, buttons);
-    cout << "min. amount of button pushes: " << min_push << " discovered in " << clock.get_lap().count() << "(ms)\n";
+    const size_t h1 = min(n_but / 2, MITM_MAX_TABLE_BITS),
+                 h2 = n_but - h1;
 
-    // ============== PART 2 ==============
+    // first half: gray code k ^ (k >> 1) flips button countr_zero(k) in step k
+    thread_local MitmTable<M> table;
+    table.reset(size_t(1) << h1);
 
-    cout << "=============== PART 2 ===============\n";
-    clock.start();
-    min_push = get_joltage_button_press(joltage, buttons);
-    cout << "min. amount of button pushes: " << min_push << " discovered in " << clock.get_lap().count() << "(ms)\n";
+    M sum{};
+    table.insert_min(sum, 0);
+    for (size_t k = 1; k < (size_t(1) << h1); ++k)
+    {
+        sum ^= bitmasks[countr_zero(k)];
+        table.insert_min(sum, popcount(k ^ (k >> 1)));
+    }
+
+    // second half: look up what is missing to reach the target
+    size_t best = NO_SOLUTION;
+    M need = target;
+    for (size_t k = 0; k < (size_t(1) << h2); ++k)
+    {
+        if (k > 0)
+            need ^= bitmasks[h1 + countr_zero(k)];
 
+        const auto c = table.find(need);
+        if (c != MitmTable<M>::EMPTY)
+            best = min(best, static_cast<size_t>(c + popcount(k ^ (k >> 1))));
+    }
+
+    return best;
+}
+
+enum class LightSolver
+{
+    GF2,
+    BFS,
+    MITM,
+    BATCH
+};
+
+// number of lights a machine uses: highest light of the target or any button
+size_t light_width(const LightVec &target, const span<const LightVec> bitmasks)
+{
+    LightVec used = target;
+    for (const auto &b : bitmasks)
+        used |= b;
+
+    size_t w = MAX_LIGHTS;
+    while (w > 0 && !used[w - 1])
+        --w;
+    return w;
+}
+
+template <typename M>
+size_t solve_lights(const LightVec &target, const span<const LightVec> bitmasks, const LightSolver solver, LightBfs *bfs)
+{
+    if (bitmasks.size() > MAX_BUTTONS)
+    {
+        ostringstream oss;
+        oss << "Invalid argument: " << bitmasks.size() << " buttons, max. " << MAX_BUTTONS;
+        throw invalid_argument(oss.str());
+    }
+
+    // on the stack, no machine allocates
+    array<M, MAX_BUTTONS> buffer;
+    for (size_t j = 0; j < bitmasks.size(); ++j)
+        buffer[j] = to_mask<M>(bitmasks[j]);
+    const span<const M> masks(buffer.data(), bitmasks.size());
+
+    if constexpr (is_same_v<M, uint16_t>)
+        if (solver == LightSolver::BFS && bfs)
+            return bfs->solve(to_mask<M>(target), masks);
+
+    if (solver == LightSolver::MITM && masks.size() <= MITM_MAX_BUTTONS)
+        return solve_lights_mitm(to_mask<M>(target), masks);
+
+    return solve_lights_gf2(to_mask<M>(target), masks);
+}
+
+// picks the narrowest mask for the machine, the BFS only exists for up to
+// BFS_MAX_LIGHTS lights, wider machines always use GF(2)
+size_t solve_lights(const LightVec &target, const span<const LightVec> bitmasks, const LightSolver solver, LightBfs *bfs)
+{
+    const auto w = light_width(target, bitmasks);
+
+    if (w <= mask_bits<uint16_t>)
+        return solve_lights<uint16_t>(target, bitmasks, solver, bfs);
+    else if (w <= mask_bits<uint32_t>)
+        return solve_lights<uint32_t>(target, bitmasks, solver, bfs);
+    else if (w <= mask_bits<uint64_t>)
+        return solve_lights<uint64_t>(target, bitmasks, solver, bfs);
+    else
+        return solve_lights<WideMask<MAX_LIGHTS / 64>>(target, bitmasks, solver, bfs);
+}
+
+// Most machines have at most 16 lights and few buttons, so part 1 can solve
+// a batch of them at once: lane l of every vector belongs to machine l, with
+// 32 machines of up to 8 lights or 16 of up to 16 lights per AVX2 register.
+// All button subsets are enumerated in Gray code order, each step XORs one
+// button vector into the states of all lanes and keeps the popcount of the
+// subset in every lane whose state hit its target. Machines with fewer
+// buttons get zero masks, which never lower the minimum. With AVX2 a step is
+// a handful of instructions on one register, otherwise a scalar loop.
+constexpr const size_t BATCH_MAX_BUTTONS = 12;
+
+// step k of the Gray code flips button countr_zero(k) and leaves
+// popcount(k ^ (k >> 1)) buttons pressed, precomputed for the inner loop
+struct GrayStep
+{
+    uint8_t button, pressed;
+};
+
+const array<GrayStep, size_t(1) << BATCH_MAX_BUTTONS> &gray_steps()
+{
+    static const auto steps = []
+    {
+        array<GrayStep, size_t(1) << BATCH_MAX_BUTTONS> s{};
+        for (size_t k = 1; k < s.size(); ++k)
+            s[k] = {static_cast<uint8_t>(countr_zero(k)), static_cast<uint8_t>(popcount(k ^ (k >> 1)))};
+        return s;
+    }();
+    return steps;
+}
+
+template <typename L>
+struct LightBatch
+{
+    constexpr static const size_t LANES = 32 / sizeof(L);
+    constexpr static const L UNREACHED = numeric_limits<L>::max();
+    using Lanes = array<L, LANES>;
+
+    Lanes target{};
+    array<Lanes, BATCH_MAX_BUTTONS> buttons{};
+    size_t n_buttons = 0,
+           n = 0;
+
+    static bool fits(const MachineView &m)
+    {
+        return m.buttons.size() <= BATCH_MAX_BUTTONS && light_width(m.target, m.buttons) <= mask_bits<L>;
+    }
+
+    void add(const MachineView &m)
+    {
+        target[n] = to_mask<L>(m.target);
+        for (size_t j = 0; j < m.buttons.size(); ++j)
+            buttons[j][n] = to_mask<L>(m.buttons[j]);
+        n_buttons = max(n_buttons, m.buttons.size());
+        ++n;
+    }
+};
+
+template <typename L>
+void solve_light_batch_scalar(const LightBatch<L> &b, typename LightBatch<L>::Lanes &best)
+{
+    const auto &steps = gray_steps();
+    typename LightBatch<L>::Lanes state{};
+    for (size_t l = 0; l < best.size(); ++l)
+        best[l] = b.target[l] == 0 ? 0 : LightBatch<L>::UNREACHED;
+
+    for (size_t k = 1; k < (size_t(1) << b.n_buttons); ++k)
+    {
+        const auto &button = b.buttons[steps[k].button];
+        const L pc = steps[k].pressed;
+        for (size_t l = 0; l < best.size(); ++l)
+        {
+            state[l] ^= button[l];
+            if (state[l] == b.target[l])
+                best[l] = min(best[l], pc);
+        }
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// keeps ~best, the largest ~pressed of all hits: max(acc, hit & ~pressed),
+// so lanes need no blend and the accumulator no separate miss mask
+template <typename L>
+__attribute__((target("avx2"))) void solve_light_batch_avx2(const LightBatch<L> &b, typename LightBatch<L>::Lanes &best)
+{
+    const auto *const buttons = reinterpret_cast<const __m256i *>(b.buttons.data());
+
+    // ~pressed for every possible number of pressed buttons
+    __m256i not_pressed[BATCH_MAX_BUTTONS + 1];
+    for (size_t p = 0; p <= BATCH_MAX_BUTTONS; ++p)
+        not_pressed[p] = sizeof(L) == 1 ? _mm256_set1_epi8(static_cast<char>(~p))
+                                        : _mm256_set1_epi16(static_cast<short>(~p));
+
+    // every subset of the first LOW buttons, with its number of pressed buttons
+    constexpr const size_t LOW = 4;
+    __m256i low[1 << LOW];
+    uint8_t low_pressed[1 << LOW];
+    low[0] = _mm256_setzero_si256();
+    low_pressed[0] = 0;
+    for (size_t j = 1; j < (1 << LOW); ++j)
+    {
+        const auto k = countr_zero(j);
+        low[j] = _mm256_xor_si256(low[j & (j - 1)], _mm256_loadu_si256(buttons + k));
+        low_pressed[j] = static_cast<uint8_t>(popcount(j));
+    }
+
+    // the Gray code runs over the other buttons only, each of its steps tries
+    // all low subsets at once, which are independent of each other
+    const auto &steps = gray_steps();
+    const __m256i target = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.target.data()));
+    __m256i high = _mm256_setzero_si256(),
+            acc = _mm256_setzero_si256();
+    const size_t n_high = b.n_buttons > LOW ? b.n_buttons - LOW : 0;
+    for (size_t k = 0; k < (size_t(1) << n_high); ++k)
+    {
+        if (k)
+            high = _mm256_xor_si256(high, _mm256_loadu_si256(buttons + LOW + steps[k].button));
+        const auto *const np = not_pressed + steps[k].pressed;
+        for (size_t j = 0; j < (1 << LOW); ++j)
+        {
+            const __m256i state = _mm256_xor_si256(high, low[j]);
+            if constexpr (sizeof(L) == 1)
+                acc = _mm256_max_epu8(acc, _mm256_and_si256(_mm256_cmpeq_epi8(state, target), np[low_pressed[j]]));
+            else
+                acc = _mm256_max_epu16(acc, _mm256_and_si256(_mm256_cmpeq_epi16(state, target), np[low_pressed[j]]));
+        }
+    }
+
+    // lanes that never hit their target end up as ~0 = UNREACHED
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(best.data()), _mm256_xor_si256(acc, _mm256_set1_epi8(-1)));
+}
+#endif
+
+// n_push[l] for lane l < b.n, NO_SOLUTION if its target is not reachable
+template <typename L>
+void solve_light_batch(const LightBatch<L> &b, span<size_t> n_push)
+{
+    typename LightBatch<L>::Lanes best;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2)
+        solve_light_batch_avx2(b, best);
+    else
+#endif
+        solve_light_batch_scalar(b, best);
+
+    for (size_t l = 0; l < b.n && l < n_push.size(); ++l)
+        n_push[l] = best[l] == LightBatch<L>::UNREACHED ? NO_SOLUTION : best[l];
+}
+
+// Solves machines that fit a 16 bit batch, at most 32 at a time: the ones
+// with up to 8 lights in an 8 bit batch, the rest 16 at a time. The caller
+// checks LightBatch<uint16_t>::fits, light_width is too slow to repeat here.
+constexpr const size_t MAX_LIGHT_BATCH = LightBatch<uint8_t>::LANES;
+
+void solve_light_batches(const span<const MachineView> machines, const span<size_t> n_push)
+{
+    LightBatch<uint8_t> narrow;
+    array<size_t, MAX_LIGHT_BATCH> narrow_idx, n;
+    LightBatch<uint16_t> wide;
+    array<size_t, LightBatch<uint16_t>::LANES> wide_idx;
+
+    const auto flush_wide = [&]
+    {
+        solve_light_batch(wide, n);
+        for (size_t l = 0; l < wide.n; ++l)
+            n_push[wide_idx[l]] = n[l];
+        wide = {};
+    };
+
+    const auto narrow_fits = [](const MachineView &m)
+    {
+        auto used = to_mask<uint16_t>(m.target);
+        for (const auto &b : m.buttons)
+            used |= to_mask<uint16_t>(b);
+        return used <= numeric_limits<uint8_t>::max();
+    };
+
+    for (size_t i = 0; i < machines.size() && i < MAX_LIGHT_BATCH; ++i)
+        if (narrow_fits(machines[i]))
+        {
+            narrow_idx[narrow.n] = i;
+            narrow.add(machines[i]);
+        }
+        else
+        {
+            wide_idx[wide.n] = i;
+            wide.add(machines[i]);
+            if (wide.n == wide.LANES)
+                flush_wide();
+        }
+
+    if (narrow.n)
+    {
+        solve_light_batch(narrow, n);
+        for (size_t l = 0; l < narrow.n; ++l)
+            n_push[narrow_idx[l]] = n[l];
+    }
+    if (wide.n)
+        flush_wide();
+}
+
+// Many machines are the same up to the order of their buttons and lights.
+// The cache keys every machine by a canonical form: lights are relabeled by
+// (target, joltage, number of buttons wired to it) and the relabeled button
+// masks are sorted. The key holds the whole machine, so a hit is always an
+// equivalent machine; lights that tie keep their input order, so some
+// equivalent machines may still miss.
+// Results are shared by all workers (one lock per shard) and can be kept in a
+// binary file between runs:
+//     magic, n_entries, n_entries * (key size, key words, lights, joltage)
+struct SolutionCache
+{
+    using Key = vector<uint64_t>;
+    static constexpr const uint64_t UNSOLVED = NO_SOLUTION - 1;
+    // "D10CAC02", the last two characters are the format version: bump it
+    // whenever the key or the meaning of a solution changes
+    static constexpr const uint64_t MAGIC = 0x3230434143303144ull;
+    static constexpr const size_t N_SHARDS = 64;
+    static constexpr const size_t N_KEY_WORDS = MAX_LIGHTS / 64;
+
+    struct Entry
+    {
+        uint64_t lights = UNSOLVED,
+                 joltage = UNSOLVED;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const
+        {
+            // FNV-1a over the key words
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (const auto &w : k)
+                h = (h ^ w) * 0x100000001b3ull;
+            return h;
+        }
+    };
+
+    struct Shard
+    {
+        mutex m;
+        unordered_map<Key, Entry, KeyHash> map;
+    };
+
+    vector<Key> keys; // canonical key of every machine of the current input
+    vector<size_t> hash;
+    array<Shard, N_SHARDS> shards;
+    size_t max_shard_entries = 0; // 0 for no limit, new keys are dropped when a shard is full
+
+    static Key canonical_key(const MachineView &m)
+    {
+        size_t n = m.jolt.size();
+        LightVec used = m.target;
+        for (const auto &b : m.buttons)
+            used |= b;
+        for (size_t i = n; i < MAX_LIGHTS; ++i)
+            if (used[i])
+                n = i + 1;
+
+        vector<size_t> degree(n, 0);
+        for (const auto &b : m.buttons)
+            for (size_t i = 0; i < n; ++i)
+                degree[i] += b[i];
+
+        const auto light_key = [&](const size_t i)
+        { return make_tuple(m.target[i], i < m.jolt.size() ? m.jolt[i] : 0, degree[i]); };
+
+        vector<size_t> perm(n), pos(n);
+        iota(perm.begin(), perm.end(), 0);
+        stable_sort(perm.begin(), perm.end(), [&](const auto &a, const auto &b)
+                    { return light_key(a) < light_key(b); });
+        for (size_t k = 0; k < n; ++k)
+            pos[perm[k]] = k;
+
+        constexpr const size_t n_words = N_KEY_WORDS;
+        vector<array<uint64_t, n_words>> masks(m.buttons.size());
+        for (size_t j = 0; j < m.buttons.size(); ++j)
+        {
+            masks[j].fill(0);
+            for (size_t i = 0; i < n; ++i)
+                if (m.buttons[j][i])
+                    masks[j][pos[i] / 64] |= uint64_t(1) << (pos[i] % 64);
+        }
+        sort(masks.begin(), masks.end());
+
+        Key key{n, m.buttons.size()};
+        array<uint64_t, n_words> t{};
+        for (size_t k = 0; k < n; ++k)
+            if (m.target[perm[k]])
+                t[k / 64] |= uint64_t(1) << (k % 64);
+        key.insert(key.end(), t.begin(), t.end());
+        for (const auto &i : perm)
+            key.push_back(i < m.jolt.size() ? m.jolt[i] : 0);
+        for (const auto &m : masks)
+            key.insert(key.end(), m.begin(), m.end());
+
+        return key;
+    }
+
+    void index(const MachineSet &machines)
+    {
+        keys.resize(machines.size());
+        hash.resize(machines.size());
+        for (size_t i = 0; i < machines.size(); ++i)
+        {
+            keys[i] = canonical_key(machines[i]);
+            hash[i] = KeyHash{}(keys[i]);
+        }
+    }
+
+    Shard &shard(const size_t h) { return shards[h % N_SHARDS]; }
+
+    Entry find(const Key &key, const size_t h)
+    {
+        auto &s = shard(h);
+        lock_guard<mutex> lock(s.m);
+        const auto it = s.map.find(key);
+        return it == s.map.end() ? Entry{} : it->second;
+    }
+
+    // keeps at most about max_entries solutions, the first ones stored win
+    void limit(const size_t max_entries)
+    {
+        max_shard_entries = (max_entries + N_SHARDS - 1) / N_SHARDS;
+    }
+
+    // entry of key, nullptr if it is new and the shard is full; call with s.m locked
+    Entry *slot(Shard &s, const Key &key)
+    {
+        if (const auto it = s.map.find(key); it != s.map.end())
+            return &it->second;
+        if (max_shard_entries && s.map.size() >= max_shard_entries)
+            return nullptr;
+        return &s.map[key];
+    }
+
+    void store_lights(const Key &key, const size_t h, const size_t n)
+    {
+        auto &s = shard(h);
+        lock_guard<mutex> lock(s.m);
+        if (auto e = slot(s, key))
+            e->lights = n;
+    }
+
+    void store_joltage(const Key &key, const size_t h, const size_t n)
+    {
+        auto &s = shard(h);
+        lock_guard<mutex> lock(s.m);
+        if (auto e = slot(s, key))
+            e->joltage = n;
+    }
+
+    // by index of a machine of the current input, see index()
+    bool find_lights(const size_t machine, size_t &n)
+    {
+        n = find(keys[machine], hash[machine]).lights;
+        return n != UNSOLVED;
+    }
+
+    bool find_joltage(const size_t machine, size_t &n)
+    {
+        n = find(keys[machine], hash[machine]).joltage;
+        return n != UNSOLVED;
+    }
+
+    void store_lights(const size_t machine, const size_t n) { store_lights(keys[machine], hash[machine], n); }
+
+    void store_joltage(const size_t machine, const size_t n) { store_joltage(keys[machine], hash[machine], n); }
+
+    size_t size() const
+    {
+        size_t n = 0;
+        for (const auto &s : shards)
+            n += s.map.size();
+        return n;
+    }
+
+    void clear()
+    {
+        for (auto &s : shards)
+            s.map.clear();
+    }
+
+    // a key is {n_lights, n_buttons, target, joltage, button masks}, see canonical_key
+    static bool valid_key_size(const uint64_t size)
+    {
+        return size >= 2 + N_KEY_WORDS && size <= 2 + N_KEY_WORDS + MAX_LIGHTS + MAX_BUTTONS * N_KEY_WORDS;
+    }
+
+    static bool valid_key(const Key &key)
+    {
+        return key[0] <= MAX_LIGHTS && key[1] <= MAX_BUTTONS &&
+               key.size() == 2 + N_KEY_WORDS + key[0] + key[1] * N_KEY_WORDS;
+    }
+
+    // all or nothing: a file that can not be read completely leaves the cache empty
+    int load(const string &fname)
+    {
+        const int err = load_entries(fname);
+        if (err)
+            clear();
+        return err;
+    }
+
+    int load_entries(const string &fname)
+    {
+        ifstream f(fname, ios::binary);
+        if (!f.is_open())
+            return -1;
+
+        const auto read_u64 = [&f]()
+        {
+            uint64_t v = 0;
+            f.read(reinterpret_cast<char *>(&v), sizeof(v));
+            return v;
+        };
+
+        if (read_u64() != MAGIC)
+            return -1;
+
+        const auto n_entries = read_u64();
+        for (uint64_t e = 0; e < n_entries; ++e)
+        {
+            const auto key_size = read_u64();
+            if (!f || !valid_key_size(key_size))
+                return -1;
+
+            Key key(key_size);
+            f.read(reinterpret_cast<char *>(key.data()), key.size() * sizeof(uint64_t));
+
+            Entry entry;
+            entry.lights = read_u64();
+            entry.joltage = read_u64();
+            if (!f || !valid_key(key))
+                return -1;
+
+            shard(KeyHash{}(key)).map[move(key)] = entry;
+        }
+
+        return 0;
+    }
+
+    int save(const string &fname) const
+    {
+        ofstream f(fname, ios::binary | ios::trunc);
+        if (!f.is_open())
+            return -1;
+
+        const auto write_u64 = [&f](const uint64_t v)
+        { f.write(reinterpret_cast<const char *>(&v), sizeof(v)); };
+
+        write_u64(MAGIC);
+        write_u64(size());
+        for (const auto &s : shards)
+            for (const auto &[key, entry] : s.map)
+            {
+                write_u64(key.size());
+                f.write(reinterpret_cast<const char *>(key.data()), key.size() * sizeof(uint64_t));
+                write_u64(entry.lights);
+                write_u64(entry.joltage);
+            }
+
+        return f ? 0 : -1;
+    }
+};
+
+size_t switch_buttons(const MachineSet &machines, const vector<size_t> &order, SolutionCache &cache, const LightSolver solver = LightSolver::GF2)
+{
+    // try to push buttons to switch all lights on, every machine writes its own slot
+    MachineScheduler scheduler;
+    vector<LightBfs> bfs(solver == LightSolver::BFS ? scheduler.n_workers : 0);
+    vector<size_t> n_push_machine(machines.size(), 0);
+
+    vector<size_t> single = order;
+    if (solver == LightSolver::BATCH)
+    {
+        // machines that fit are solved MAX_LIGHT_BATCH at a time, still in cost
+        // order but with the ones that fit an 8 bit batch first
+        vector<size_t> batched;
+        single.clear();
+        for (const auto &i : order)
+            (LightBatch<uint16_t>::fits(machines[i]) ? batched : single).push_back(i);
+        stable_partition(batched.begin(), batched.end(), [&](const size_t i)
+                         { return LightBatch<uint8_t>::fits(machines[i]); });
+
+        vector<size_t> batch_order((batched.size() + MAX_LIGHT_BATCH - 1) / MAX_LIGHT_BATCH);
+        iota(batch_order.begin(), batch_order.end(), 0);
+
+        scheduler.run(batch_order, [&](const size_t b, const size_t)
+                      {
+            const auto first = batched.begin() + b * MAX_LIGHT_BATCH;
+            const auto n = min<size_t>(MAX_LIGHT_BATCH, batched.end() - first);
+            TraceScope trace("light batch", first[0]);
+
+            array<MachineView, MAX_LIGHT_BATCH> views;
+            for (size_t l = 0; l < n; ++l)
+                views[l] = machines[first[l]];
+
+            array<size_t, MAX_LIGHT_BATCH> n_push;
+            solve_light_batches(span(views.data(), n), n_push);
+            for (size_t l = 0; l < n; ++l)
+            {
+                n_push_machine[first[l]] = n_push[l];
+                cache.store_lights(first[l], n_push[l]);
+            } });
+    }
+
+    // everything else one by one, machines that do not fit a batch use GF(2)
+    scheduler.run(single, [&](const size_t i, const size_t w)
+                  {
+        TraceScope span("lights", i);
+        if (cache.find_lights(i, n_push_machine[i]))
+            return;
+        const auto m = machines[i];
+        n_push_machine[i] = solve_lights(m.target, m.buttons, solver, bfs.empty() ? nullptr : &bfs[w]);
+        cache.store_lights(i, n_push_machine[i]); });
+
+    size_t num_push = 0;
+    for (size_t i = 0; i < machines.size(); ++i)
+    {
+        if (n_push_machine[i] == NO_SOLUTION)
+        {
+            cout << "machine " << i << " can not be started\n";
+            continue;
+        }
+        num_push += n_push_machine[i];
+    }
+
+    return num_push;
+}
+
+// PART 2
+
+// Every press of button j adds one to all counters it is wired to, so the
+// presses x of a machine solve the integer program
+//     min sum(x)  s.t.  A * x = joltage,  x >= 0 integer
+// with A[i][j] = 1 if button j is wired to counter i.
+// A is reduced fraction free to row echelon form, which leaves each pivot
+// button as an affine function of the (few) free buttons:
+//     d_k * x[pivot_col[k]] = rhs_k - sum_f m[k][f] * x[f]
+// so the presses are linear in the free buttons, sum(x) = c0 + sum_f c_f * x[f],
+// and the free buttons only have to keep every pivot >= 0 and stay below the
+// smallest counter they are wired to. That is solved by branch and bound on
+// the LP relaxation: the LP optimum is a lower bound, a branch that can not
+// beat the best solution is dropped, otherwise a fractional free button, or
+// a pivot that is not an integer, splits the branch in two.
+
+// Dense two phase simplex for small problems:
+//     min c * x  s.t.  a * x <= b,  x >= 0
+// Rows with b < 0 start from an artificial variable. The steepest column
+// enters, after many pivots Bland's rule takes over so it can not cycle.
+struct SmallLp
+{
+    constexpr static const double EPS = 1e-9;
+    constexpr static const double INFEASIBLE = numeric_limits<double>::infinity();
+
+    vector<vector<double>> t; // constraints, then phase 1 and phase 2 objective, rhs last
+    vector<size_t> basis;
+
+    void pivot(const size_t r, const size_t c)
+    {
+        auto &row = t[r];
+        const auto p = row[c];
+        for (auto &v : row)
+            v /= p;
+        for (size_t i = 0; i < t.size(); ++i)
+        {
+            if (i == r || fabs(t[i][c]) < EPS)
+                continue;
+            const auto f = t[i][c];
+            for (size_t j = 0; j < row.size(); ++j)
+                t[i][j] -= f * row[j];
+        }
+        basis[r] = c;
+    }
+
+    // minimizes objective row o over the first n_cols columns, false if unbounded
+    bool optimize(const size_t o, const size_t n_cols)
+    {
+        const size_t n_rows = basis.size(), rhs = t[o].size() - 1;
+        for (size_t iter = 0;; ++iter)
+        {
+            const bool bland = iter > 4 * (n_rows + n_cols);
+            size_t c = n_cols;
+            for (size_t j = 0; j < n_cols; ++j)
+                if (t[o][j] < -EPS && (c == n_cols || (!bland && t[o][j] < t[o][c])))
+                {
+                    c = j;
+                    if (bland)
+                        break;
+                }
+            if (c == n_cols)
+                return true;
+
+            size_t r = n_rows;
+            for (size_t i = 0; i < n_rows; ++i)
+            {
+                if (t[i][c] <= EPS)
+                    continue;
+                if (r == n_rows)
+                {
+                    r = i;
+                    continue;
+                }
+                const auto d = t[i][rhs] / t[i][c] - t[r][rhs] / t[r][c];
+                if (d < -EPS || (d < EPS && basis[i] < basis[r]))
+                    r = i;
+            }
+            if (r == n_rows)
+                return false;
+            pivot(r, c);
+        }
+    }
+
+    // optimal value, INFEASIBLE if there is no solution
+    double solve(const vector<vector<double>> &a, const vector<double> &b, const vector<double> &c)
+    {
+        const size_t n_rows = a.size(), n = c.size();
+        size_t n_art = 0;
+        for (const auto &v : b)
+            n_art += v < 0;
+
+        // columns: x, slack, artificial, rhs
+        const size_t n_cols = n + n_rows + n_art, rhs = n_cols;
+        t.assign(n_rows + 2, vector<double>(n_cols + 1, 0.0));
+        basis.assign(n_rows, 0);
+        auto &phase1 = t[n_rows], &phase2 = t[n_rows + 1];
+
+        for (size_t j = 0; j < n; ++j)
+            phase2[j] = c[j];
+
+        for (size_t i = 0, art = n + n_rows; i < n_rows; ++i)
+        {
+            const double s = b[i] < 0 ? -1.0 : 1.0;
+            for (size_t j = 0; j < n; ++j)
+                t[i][j] = s * a[i][j];
+            t[i][n + i] = s;
+            t[i][rhs] = s * b[i];
+            if (b[i] < 0)
+            {
+                t[i][art] = 1.0;
+                basis[i] = art++;
+                for (size_t j = 0; j <= n_cols; ++j)
+                    phase1[j] -= t[i][j];
+                phase1[basis[i]] = 0.0;
+            }
+            else
+                basis[i] = n + i;
+        }
+
+        if (n_art > 0)
+        {
+            optimize(n_rows, n_cols);
+            if (-phase1[rhs] > 1e-7)
+                return INFEASIBLE;
+
+            // drive artificial variables at zero out of the basis where possible
+            for (size_t i = 0; i < n_rows; ++i)
+                if (basis[i] >= n + n_rows)
+                    for (size_t j = 0; j < n + n_rows; ++j)
+                        if (fabs(t[i][j]) > EPS)
+                        {
+                            pivot(i, j);
+                            break;
+                        }
+        }
+
+        // all variables are bounded by the callers, so this does not happen
+        if (!optimize(n_rows + 1, n + n_rows))
+            return -INFEASIBLE;
+        return -phase2[rhs];
+    }
+
+    // value of variable j in the last solution
+    double value(const size_t j) const
+    {
+        for (size_t i = 0; i < basis.size(); ++i)
+            if (basis[i] == j)
+                return t[i].back();
+        return 0.0;
+    }
+};
+
+struct JoltageIlp
+{
+    vector<vector<jmat_t>> m; // [A | joltage], one row per counter
+    vector<size_t> pivot_col, free_col;
+    vector<jmat_t> ub, x;
+    vector<jmat_t> free_lo, free_hi, // bounds of the free buttons in this branch
+        pivot_lo, pivot_hi;          // and of the pivot buttons
+    size_t n_but = 0;
+    jmat_t best = 0;
+
+    // LP over y = x[free] - free_lo: rows pivot >= lo, pivot <= hi, y <= hi - lo
+    SmallLp lp;
+    vector<vector<double>> lp_a;
+    vector<double> lp_b, lp_c;
+    double lp_c0 = 0;
+
+    size_t solve(const MachineView &machine)
+    {
+        const auto &joltage = machine.jolt;
+        const size_t n_rows = joltage.size();
+        n_but = machine.buttons.size();
+
+        m.assign(n_rows, vector<jmat_t>(n_but + 1, 0));
+        ub.assign(n_but, 0);
+        x.assign(n_but, 0);
+        for (size_t i = 0; i < n_rows; ++i)
+            m[i][n_but] = joltage[i];
+
+        for (size_t j = 0; j < n_but; ++j)
+        {
+            // a button can not be pressed more often than its smallest counter allows
+            bool wired = false;
+            for (size_t i = 0; i < n_rows; ++i)
+                if (machine.buttons[j][i])
+                {
+                    m[i][j] = 1;
+                    ub[j] = wired ? min<jmat_t>(ub[j], joltage[i]) : joltage[i];
+                    wired = true;
+                }
+        }
+
+        const size_t rank = reduce_joltage_matrix(m, n_but, pivot_col);
+        free_col.clear();
+        vector<bool> is_pivot(n_but, false);
+        for (const auto &c : pivot_col)
+            is_pivot[c] = true;
+        for (size_t c = 0; c < n_but; ++c)
+            if (!is_pivot[c])
+                free_col.push_back(c);
+
+        // remaining rows are all zero on the left side
+        for (size_t r = rank; r < n_rows; ++r)
+            if (m[r][n_but] != 0)
+                return NO_SOLUTION;
+
+        // branch on the free buttons with the tightest bounds first
+        stable_sort(free_col.begin(), free_col.end(), [&](const size_t a, const size_t b)
+                    { return ub[a] < ub[b]; });
+        const size_t n_free = free_col.size();
+
+        // presses: sum_k rhs_k / d_k + sum_f (1 - sum_k m[k][f] / d_k) * x[f]
+        lp_a.assign(2 * rank + n_free, vector<double>(n_free, 0.0));
+        lp_c.assign(n_free, 1.0);
+        lp_c0 = 0;
+        for (size_t k = 0; k < rank; ++k)
+        {
+            const auto d = static_cast<double>(m[k][pivot_col[k]]);
+            for (size_t f = 0; f < n_free; ++f)
+            {
+                lp_a[k][f] = static_cast<double>(m[k][free_col[f]]);
+                lp_a[rank + k][f] = -lp_a[k][f];
+                lp_c[f] -= lp_a[k][f] / d;
+            }
+            lp_c0 += static_cast<double>(m[k][n_but]) / d;
+        }
+        for (size_t f = 0; f < n_free; ++f)
+            lp_a[2 * rank + f][f] = 1.0;
+
+        free_lo.assign(n_free, 0);
+        free_hi.resize(n_free);
+        for (size_t f = 0; f < n_free; ++f)
+            free_hi[f] = ub[free_col[f]];
+        pivot_lo.assign(rank, 0);
+        pivot_hi.resize(rank);
+        for (size_t k = 0; k < rank; ++k)
+            pivot_hi[k] = ub[pivot_col[k]];
+
+        best = numeric_limits<jmat_t>::max();
+        search();
+
+        return best == numeric_limits<jmat_t>::max() ? NO_SOLUTION : static_cast<size_t>(best);
+    }
+
+    // The search keeps its own stack, a branch per narrowed bound would
+    // otherwise recurse as deep as the joltage is large. A branch sets one of
+    // the bounds above to value, the bounds it changes on the way down are
+    // kept in trail with their old value, level is the length of the trail
+    // at the node that created the branch.
+    struct Branch
+    {
+        jmat_t *bound;
+        jmat_t value;
+        size_t level;
+    };
+    vector<Branch> open; // branches left to search, the next one last
+    vector<pair<jmat_t *, jmat_t>> trail;
+    vector<double> v;
+
+    void search()
+    {
+        open.clear();
+        trail.clear();
+        expand();
+        while (!open.empty())
+        {
+            const auto b = open.back();
+            open.pop_back();
+            for (; trail.size() > b.level; trail.pop_back())
+                *trail.back().first = trail.back().second;
+
+            trail.emplace_back(b.bound, *b.bound);
+            *b.bound = b.value;
+            expand();
+        }
+    }
+
+    // queues the branches bound = first and then bound = second
+    void branch(jmat_t &first_bound, const jmat_t first, jmat_t &second_bound, const jmat_t second)
+    {
+        open.push_back({&second_bound, second, trail.size()});
+        open.push_back({&first_bound, first, trail.size()});
+    }
+
+    // bounds one node, either queues its two branches or records a solution
+    void expand()
+    {
+        const size_t n_free = free_col.size(),
+                     rank = pivot_col.size();
+        for (size_t f = 0; f < n_free; ++f)
+            if (free_lo[f] > free_hi[f])
+                return;
+
+        // d_k * pivot = rhs_k - sum_f m[k][f] * (free_lo + y)
+        lp_b.resize(2 * rank + n_free);
+        double shift = 0;
+        for (size_t k = 0; k < rank; ++k)
+        {
+            const auto d = m[k][pivot_col[k]];
+            jmat_t r = m[k][n_but];
+            for (size_t f = 0; f < n_free; ++f)
+                r -= m[k][free_col[f]] * free_lo[f];
+            lp_b[k] = static_cast<double>(r - d * pivot_lo[k]);
+            lp_b[rank + k] = static_cast<double>(d * pivot_hi[k] - r);
+        }
+        for (size_t f = 0; f < n_free; ++f)
+        {
+            lp_b[2 * rank + f] = static_cast<double>(free_hi[f] - free_lo[f]);
+            shift += lp_c[f] * static_cast<double>(free_lo[f]);
+        }
+
+        const auto z = lp.solve(lp_a, lp_b, lp_c);
+
+        // presses are integers, so the branch must be able to get below best
+        if (z == SmallLp::INFEASIBLE || lp_c0 + shift + z > static_cast<double>(best) - 1 + 1e-6)
+            return;
+
+        v.resize(n_free);
+        for (size_t f = 0; f < n_free; ++f)
+            v[f] = static_cast<double>(free_lo[f]) + lp.value(f);
+
+        // a fractional free button: x <= floor(v) or x >= ceil(v), nearer side first
+        for (size_t f = 0; f < n_free; ++f)
+        {
+            const auto lo = static_cast<jmat_t>(floor(v[f] + 1e-6));
+            if (v[f] - static_cast<double>(lo) <= 1e-6)
+                continue;
+
+            if (v[f] - static_cast<double>(lo) < 0.5)
+                branch(free_hi[f], lo, free_lo[f], lo + 1);
+            else
+                branch(free_lo[f], lo + 1, free_hi[f], lo);
+            return;
+        }
+
+        for (size_t f = 0; f < n_free; ++f)
+            x[free_col[f]] = llround(v[f]);
+
+        // all free buttons are integers, the pivots have to be as well
+        jmat_t sum = 0;
+        for (const auto &f : free_col)
+            sum += x[f];
+        for (size_t k = 0; k < pivot_col.size(); ++k)
+        {
+            jmat_t r = m[k][n_but];
+            for (const auto &f : free_col)
+                r -= m[k][f] * x[f];
+
+            const auto d = m[k][pivot_col[k]];
+            if (r < 0)
+                return;
+            if (r % d == 0)
+            {
+                sum += r / d;
+                continue;
+            }
+
+            // pivot <= floor(r / d) or pivot >= ceil(r / d)
+            const auto lo = r / d;
+            branch(pivot_hi[k], lo, pivot_lo[k], lo + 1);
+            return;
+        }
+
+        best = min(best, sum);
+    }
+};
+
+// Second engine for part 2: the lowest bit of every counter is decided by the
+// buttons pressed an odd number of times, i.e. by a part 1 light pattern.
+// So press a subset S of buttons (at most once each) whose toggle pattern
+// matches the parity of the target, then every remaining counter is even and
+// the rest of the presses come in pairs:
+//     f(t) = min_S |S| + 2 * f((t - count(S)) / 2),   f(0) = 0
+// The target halves on every level, so the depth is logarithmic in the joltage.
+struct JoltVecHash
+{
+    size_t operator()(const joltVec &v) const
+    {
+        size_t h = v.size();
+        for (const auto &x : v)
+            h ^= hash<joltage_t>{}(x) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+// 2^n subsets per machine: with 10 counters halving needs ~6 ms at 14 buttons
+// and grows ~5x per button, while the ILP stays at ~0.1 ms for most machines
+constexpr const size_t MAX_HALVING_BUTTONS = 14;
+
+struct JoltageHalving
+{
+    // subset s of the buttons increases counter i by counts[s * n_counters + i],
+    // subsets[group.first, group.second) are the ones toggling one pattern
+    vector<joltage_t> counts;
+    vector<LightVec> patterns;
+    vector<uint32_t> subsets;
+    unordered_map<LightVec, pair<size_t, size_t>> by_pattern;
+    size_t n_counters = 0;
+
+    unordered_map<joltVec, size_t, JoltVecHash> memo;
+    joltVec next;
+
+    // larger machines go to the ILP
+    static bool fits(const MachineView &m)
+    {
+        return m.buttons.size() <= MAX_HALVING_BUTTONS && m.jolt.size() <= MAX_LIGHTS;
+    }
+
+    size_t solve(const MachineView &machine)
+    {
+        const auto &joltage = machine.jolt;
+        const auto &bitmasks = machine.buttons;
+        const size_t n_but = bitmasks.size();
+        if (n_but > MAX_HALVING_BUTTONS || joltage.size() > MAX_LIGHTS)
+        {
+            ostringstream oss;
+            oss << "Invalid argument: " << n_but << " buttons, " << joltage.size() << " counters";
+            throw invalid_argument(oss.str());
+        }
+
+        // every subset adds one button to the subset without its lowest one
+        const size_t n_sub = size_t(1) << n_but;
+        n_counters = joltage.size();
+        counts.assign(n_sub * n_counters, 0);
+        patterns.assign(n_sub, LightVec(0));
+        for (size_t s = 1; s < n_sub; ++s)
+        {
+            const size_t prev = s & (s - 1),
+                         j = countr_zero(s);
+            patterns[s] = patterns[prev] ^ bitmasks[j];
+            for (size_t i = 0; i < n_counters; ++i)
+                counts[s * n_counters + i] = counts[prev * n_counters + i] + bitmasks[j][i];
+        }
+
+        // group all button subsets by the light pattern they toggle
+        by_pattern.clear();
+        memo.clear();
+        for (size_t s = 0; s < n_sub; ++s)
+            ++by_pattern[patterns[s]].second;
+        size_t offset = 0;
+        for (auto &[pattern, group] : by_pattern)
+        {
+            const auto n = group.second;
+            group = {offset, offset};
+            offset += n;
+        }
+        subsets.resize(n_sub);
+        for (size_t s = 0; s < n_sub; ++s)
+            subsets[by_pattern[patterns[s]].second++] = static_cast<uint32_t>(s);
+
+        return reduce(joltVec(joltage.begin(), joltage.end()));
+    }
+
+    size_t reduce(const joltVec &target)
+    {
+        if (all_of(target.begin(), target.end(), [](const auto &t)
+                   { return t == 0; }))
+            return 0;
+
+        if (const auto it = memo.find(target); it != memo.end())
+            return it->second;
+
+        LightVec parity(0);
+        for (size_t i = 0; i < target.size(); ++i)
+            parity[i] = target[i] & 1;
+
+        size_t best = NO_SOLUTION;
+        if (const auto it = by_pattern.find(parity); it != by_pattern.end())
+        {
+            for (size_t k = it->second.first; k < it->second.second; ++k)
+            {
+                // the pressed buttons alone can not beat the best anymore
+                const auto s = subsets[k];
+                const size_t n = popcount(s);
+                if (best != NO_SOLUTION && n >= best)
+                    continue;
+
+                const auto *const count = counts.data() + s * n_counters;
+                bool fits = true;
+                next.resize(target.size());
+                for (size_t i = 0; i < target.size() && fits; ++i)
+                {
+                    fits = count[i] <= target[i];
+                    next[i] = (target[i] - count[i]) / 2;
+                }
+                if (!fits)
+                    continue;
+
+                // next is reused by the recursion
+                const auto r = reduce(joltVec(next));
+                if (r != NO_SOLUTION)
+                    best = min(best, n + 2 * r);
+            }
+        }
+
+        memo.emplace(target, best);
+        return best;
+    }
+};
+
+enum class JoltageSolver
+{
+    ILP,
+    HALVING,
+    CHECK // run both and report machines where they disagree
+};
+
+size_t get_joltage_button_press(const MachineSet &machines, const vector<size_t> &order, SolutionCache &cache, const JoltageSolver solver = JoltageSolver::ILP)
+{
+    // every machine writes into its own slot, the sum is built after all are solved
+    MachineScheduler scheduler;
+    vector<JoltageIlp> ilp(scheduler.n_workers);
+    vector<JoltageHalving> halving(scheduler.n_workers);
+    vector<size_t> n_push_machine(machines.size(), 0),
+        mismatch(machines.size(), 0);
+
+    scheduler.run(order, [&](const size_t i, const size_t w)
+                  {
+        TraceScope span("joltage", i);
+        if (cache.find_joltage(i, n_push_machine[i]))
+            return;
+
+        const auto m = machines[i];
+        if (solver == JoltageSolver::HALVING && JoltageHalving::fits(m))
+            n_push_machine[i] = halving[w].solve(m);
+        else
+            n_push_machine[i] = ilp[w].solve(m);
+
+        if (solver == JoltageSolver::CHECK && JoltageHalving::fits(m))
+            if (const auto n = halving[w].solve(m); n != n_push_machine[i])
+                mismatch[i] = n;
+
+        cache.store_joltage(i, n_push_machine[i]); });
+
+    size_t n_push = 0;
+    for (size_t i = 0; i < n_push_machine.size(); ++i)
+    {
+        if (mismatch[i])
+            cout << "machine " << i << ": ilp " << n_push_machine[i] << " != halving " << mismatch[i] << "\n";
+
+        if (n_push_machine[i] == NO_SOLUTION)
+        {
+            cout << "joltage of machine " << i << " can not be reached\n";
+            continue;
+        }
+        n_push += n_push_machine[i];
+    }
+
+    return n_push;
+}
+
+// STREAMING
+
+// Instead of reading all machines first, the records of the tokenizer go
+// through a bounded queue to the solver threads while parsing continues, so
+// the first machine is solved right away and memory does not grow with the
+// input.
+// fixed capacity queue between the parser and the solver threads
+template <typename T>
+struct BoundedQueue
+{
+    vector<T> ring;
+    size_t head = 0,
+           count = 0;
+    bool closed = false;
+    mutex m;
+    condition_variable not_empty, not_full;
+
+    explicit BoundedQueue(const size_t capacity) : ring(capacity) {}
+
+    void push(const T &v)
+    {
+        unique_lock<mutex> lock(m);
+        not_full.wait(lock, [this]
+                      { return count < ring.size(); });
+        ring[(head + count++) % ring.size()] = v;
+        not_empty.notify_one();
+    }
+
+    bool pop(T &v)
+    {
+        unique_lock<mutex> lock(m);
+        not_empty.wait(lock, [this]
+                       { return count > 0 || closed; });
+        if (count == 0)
+            return false;
+        v = ring[head];
+        head = (head + 1) % ring.size();
+        --count;
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        lock_guard<mutex> lock(m);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+// Stream mode keeps memory bounded: the cache stops taking new machines and
+// every thread records a limited number of spans.
+constexpr const size_t STREAM_CACHE_ENTRIES = size_t(1) << 16,
+                       STREAM_TRACE_EVENTS = size_t(1) << 16;
+
+struct StreamResult
+{
+    size_t n_machines = 0,
+           lights = 0,
+           joltage = 0;
+    double first_result_ms = 0;
+};
+
+// Solves part 1 and 2 of every machine while the input is parsed. Machines
+// come in input order, so there is no ordering by cost as in the batch mode.
+int stream_machines(const string &fname, const LightSolver light_solver, const JoltageSolver joltage_solver, SolutionCache &cache, StreamResult &result)
+{
+    LineSource src;
+    if (src.open(fname))
+        return -1;
+
+    constexpr const size_t QUEUE_CAPACITY = 256;
+    BoundedQueue<MachineRecord> queue(QUEUE_CAPACITY);
+
+    const auto t_start = Profiler::get().now();
+    once_flag first;
+
+    const size_t n_workers = max<size_t>(1, thread::hardware_concurrency());
+    vector<StreamResult> partial(n_workers);
+
+    const auto worker = [&](const size_t w)
+    {
+        unique_ptr<LightBfs> bfs = light_solver == LightSolver::BFS ? make_unique<LightBfs>() : nullptr;
+        JoltageIlp ilp;
+        JoltageHalving halving;
+
+        MachineRecord rec;
+        while (queue.pop(rec))
+        {
+            TraceScope span("machine", rec.line);
+            const auto m = rec.view();
+            const auto key = SolutionCache::canonical_key(m);
+            const auto h = SolutionCache::KeyHash{}(key);
+            auto cached = cache.find(key, h);
+
+            if (cached.lights == SolutionCache::UNSOLVED)
+            {
+                cached.lights = solve_lights(m.target, m.buttons, light_solver, bfs.get());
+                cache.store_lights(key, h, cached.lights);
+            }
+            if (cached.joltage == SolutionCache::UNSOLVED)
+            {
+                cached.joltage = joltage_solver == JoltageSolver::HALVING && JoltageHalving::fits(m) ? halving.solve(m)
+                                                                                                    : ilp.solve(m);
+                if (joltage_solver == JoltageSolver::CHECK && JoltageHalving::fits(m))
+                    if (const auto n = halving.solve(m); n != cached.joltage)
+                        cout << "line " << rec.line << ": ilp " << cached.joltage << " != halving " << n << "\n";
+                cache.store_joltage(key, h, cached.joltage);
+            }
+
+            call_once(first, [&]
+                      { result.first_result_ms = (Profiler::get().now() - t_start) * 1e-6; });
+
+            auto &r = partial[w];
+            ++r.n_machines;
+            if (cached.lights == NO_SOLUTION)
+                cout << "machine in line " << rec.line << " can not be started\n";
+            else
+                r.lights += cached.lights;
+            if (cached.joltage == NO_SOLUTION)
+                cout << "joltage of machine in line " << rec.line << " can not be reached\n";
+            else
+                r.joltage += cached.joltage;
+        }
+    };
+
+    vector<thread> pool;
+    for (size_t w = 0; w < n_workers; ++w)
+        pool.emplace_back(worker, w);
+
+    // parse on this thread
+    int err = 0;
+    string_view line;
+    MachineRecord m;
+    for (size_t n = 1; src.next(line); ++n)
+    {
+        if (line.empty())
+            continue;
+        m.line = n;
+        if (!parse_machine(line, m))
+        {
+            cout << "cannot parse line " << n << "\n";
+            err = -1;
+            break;
+        }
+        queue.push(m);
+
+        // records are copies, the parsed part of the file is not needed anymore
+        constexpr const size_t RELEASE_LINES = size_t(1) << 14;
+        if (n % RELEASE_LINES == 0)
+            src.release_read();
+    }
+
+    queue.close();
+    for (auto &t : pool)
+        t.join();
+
+    for (const auto &r : partial)
+    {
+        result.n_machines += r.n_machines;
+        result.lights += r.lights;
+        result.joltage += r.joltage;
+    }
+
+    return err;
+}
+
+// BENCHMARK
+
+// Seeded random machines: every button is wired to each light with
+// probability density (at least one), the joltage comes from pressing every
+// button up to max_presses times and the target from a random button subset,
+// so every machine is solvable.
+struct BenchConfig
+{
+    uint64_t seed = 1;
+    size_t machines = 1000,
+           lights = 8,
+           buttons = 10;
+    double density = 0.4;
+    joltage_t max_presses = 20;
+    string solvers; // comma separated names to run, empty for all
+
+    // key=value, returns false for an unknown key or a value out of range
+    bool set(const string &kv)
+    {
+        const auto eq = kv.find('=');
+        if (eq == string::npos)
+            return false;
+
+        const auto key = kv.substr(0, eq);
+        const auto value = kv.substr(eq + 1);
+        try
+        {
+            if (key == "seed")
+                seed = stoull(value);
+            else if (key == "machines")
+                machines = stoul(value);
+            else if (key == "lights")
+                lights = min<size_t>(stoul(value), MAX_LIGHTS);
+            else if (key == "buttons")
+                buttons = min<size_t>(stoul(value), MAX_BUTTONS);
+            else if (key == "density")
+                density = stod(value);
+            else if (key == "presses")
+                max_presses = stoi(value);
+            else if (key == "solvers")
+                solvers = value;
+            else
+                return false;
+        }
+        catch (const logic_error &)
+        {
+            return false; // not a number
+        }
+
+        // a counter sums the presses of up to all buttons, that must fit a joltage_t
+        return lights > 0 && density >= 0 && density <= 1 && max_presses >= 0 &&
+               static_cast<uint64_t>(max_presses) * buttons <= static_cast<uint64_t>(numeric_limits<joltage_t>::max());
+    }
+};
+
+void generate_machines(const BenchConfig &cfg, MachineSet &machines)
+{
+    mt19937_64 rng(cfg.seed);
+    bernoulli_distribution wired(cfg.density), pressed(0.5);
+    uniform_int_distribution<size_t> any_light(0, cfg.lights - 1);
+    uniform_int_distribution<joltage_t> presses(0, cfg.max_presses);
+
+    machines.allocate(cfg.machines, cfg.machines * cfg.buttons, cfg.machines * cfg.lights);
+
+    MachineRecord m;
+    for (size_t k = 0; k < cfg.machines; ++k)
+    {
+        m.line = k;
+        m.n_lights = cfg.lights;
+        m.n_buttons = cfg.buttons;
+        m.target.reset();
+        fill_n(m.jolt.begin(), m.n_lights, 0);
+
+        for (size_t j = 0; j < m.n_buttons; ++j)
+        {
+            auto &b = m.buttons[j];
+            b.reset();
+            for (size_t i = 0; i < m.n_lights; ++i)
+                b[i] = wired(rng);
+            if (b.none())
+                b[any_light(rng)] = true;
+
+            const auto x = presses(rng);
+            for (size_t i = 0; i < m.n_lights; ++i)
+                m.jolt[i] += b[i] * x;
+            if (pressed(rng))
+                m.target ^= b;
+        }
+
+        machines.push_back(m);
+    }
+}
+
+// Runs every solver that applies to the machines on a single thread, checks
+// that all solvers of one part agree and prints throughput and latency as JSON.
+// The ILP is exponential in the free buttons in the worst case, so machines
+// with more than BENCH_ILP_MAX_FREE of them are left out.
+constexpr const size_t BENCH_ILP_MAX_FREE = 24;
+
+struct BenchSolver
+{
+    using Solve = function<void(span<const MachineView>, span<size_t>)>;
+
+    const char *name;
+    int part;
+    function<bool(const MachineView &)> applies;
+    size_t batch; // machines per solve call, latency is measured per call
+    Solve solve;
+
+    static Solve one_by_one(function<size_t(const MachineView &)> f)
+    {
+        return [f](const span<const MachineView> m, const span<size_t> n)
+        { n[0] = f(m[0]); };
+    }
+};
+
+int run_benchmark(const BenchConfig &cfg, ostream &os)
+{
+    MachineSet machines;
+    generate_machines(cfg, machines);
+
+    LightBfs bfs;
+    JoltageIlp ilp;
+    JoltageHalving halving;
+
+    const auto always = [](const MachineView &)
+    { return true; };
+
+    const vector<BenchSolver> solvers{
+        {"gf2", 1, always, 1, BenchSolver::one_by_one([](const MachineView &m)
+                                                      { return solve_lights(m.target, m.buttons, LightSolver::GF2, nullptr); })},
+        {"bfs", 1, [](const MachineView &m)
+         { return light_width(m.target, m.buttons) <= BFS_MAX_LIGHTS; },
+         1, BenchSolver::one_by_one([&bfs](const MachineView &m)
+                                    { return solve_lights(m.target, m.buttons, LightSolver::BFS, &bfs); })},
+        {"mitm", 1, [](const MachineView &m)
+         { return m.buttons.size() <= MITM_MAX_BUTTONS; },
+         1, BenchSolver::one_by_one([](const MachineView &m)
+                                    { return solve_lights(m.target, m.buttons, LightSolver::MITM, nullptr); })},
+        {"batch", 1, LightBatch<uint16_t>::fits, MAX_LIGHT_BATCH, solve_light_batches},
+        {"ilp", 2, [](const MachineView &m)
+         { return free_buttons(m) <= BENCH_ILP_MAX_FREE; },
+         1, BenchSolver::one_by_one([&ilp](const MachineView &m)
+                                                      { return ilp.solve(m); })},
+        {"halving", 2, JoltageHalving::fits, 1, BenchSolver::one_by_one([&halving](const MachineView &m)
+                                    { return halving.solve(m); })},
+    };
+
+    // reference result of every machine per part, from the first solver of that part
+    array<vector<size_t>, 3> reference;
+    size_t mismatches = 0;
+
+    os << fixed << setprecision(3) << "{\n  \"config\": {\"seed\": " << cfg.seed << ", \"machines\": " << cfg.machines
+       << ", \"lights\": " << cfg.lights << ", \"buttons\": " << cfg.buttons << ", \"density\": " << cfg.density
+       << ", \"presses\": " << cfg.max_presses << "},\n  \"solvers\": [";
+
+    const auto selected = [&cfg](const string &name)
+    {
+        if (cfg.solvers.empty())
+            return true;
+        const string list = "," + cfg.solvers + ",";
+        return list.find("," + name + ",") != string::npos;
+    };
+
+    bool first = true;
+    for (const auto &s : solvers)
+    {
+        if (!selected(s.name))
+            continue;
+
+        auto &ref = reference[s.part];
+        if (ref.empty())
+            ref.assign(machines.size(), SolutionCache::UNSOLVED);
+        size_t n_solved = 0;
+
+        // collect s.batch machines per call, the last call may get less
+        vector<size_t> idx;
+        vector<MachineView> views;
+        vector<size_t> n(s.batch);
+        const auto flush = [&]()
+        {
+            if (idx.empty())
+                return;
+            {
+                TraceScope span(s.name, idx.front());
+                s.solve(views, n);
+            }
+            n_solved += idx.size();
+
+            for (size_t k = 0; k < idx.size(); ++k)
+            {
+                const auto i = idx[k];
+                if (ref[i] == SolutionCache::UNSOLVED)
+                    ref[i] = n[k];
+                else if (ref[i] != n[k])
+                {
+                    cerr << "machine " << i << ": " << s.name << " " << n[k] << " != " << ref[i] << "\n";
+                    ++mismatches;
+                }
+            }
+            idx.clear();
+            views.clear();
+        };
+
+        for (size_t i = 0; i < machines.size(); ++i)
+        {
+            const auto m = machines[i];
+            if (!s.applies(m))
+                continue;
+
+            idx.push_back(i);
+            views.push_back(m);
+            if (idx.size() == s.batch)
+                flush();
+        }
+        flush();
+
+        const auto spans = Profiler::get().spans(s.name);
+        if (spans.empty())
+            continue;
+
+        const auto us = [](const TraceEvent &e)
+        { return (e.end - e.begin) * 1e-3; };
+        const auto pct = [&](const double p)
+        { return us(spans[min(spans.size() - 1, static_cast<size_t>((1.0 - p) * spans.size()))]); };
+        double total = 0;
+        for (const auto &e : spans)
+            total += us(e);
+
+        os << (first ? "\n" : ",\n") << "    {\"name\": \"" << s.name << "\", \"part\": " << s.part
+           << ", \"batch\": " << s.batch << ", \"machines\": " << n_solved << ", \"total_ms\": " << total * 1e-3
+           << ", \"machines_per_s\": " << (total > 0 ? n_solved / (total * 1e-6) : 0.0)
+           << ", \"p50_us\": " << pct(0.5) << ", \"p99_us\": " << pct(0.99) << ", \"max_us\": " << us(spans.front()) << "}";
+        first = false;
+    }
+
+    os << "\n  ],\n  \"mismatches\": " << mismatches << "\n}\n";
+
+    return mismatches ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    MachineSet machines;
+    string fname;
+
+    // --stream solves while the input is read, --trace <file> writes a Chrome
+    // trace of the run, the other arguments are positional.
+    // --bench [key=value ...] benchmarks the solvers on random machines instead,
+    // see BenchConfig for the keys
+    bool stream = false,
+         bench = false;
+    string trace_fname;
+    vector<string> args;
+    for (int i = 0; i < argc; ++i)
+    {
+        const string a = argv[i];
+        if (a == "--stream")
+            stream = true;
+        else if (a == "--bench")
+            bench = true;
+        else if (a == "--trace" && i + 1 < argc)
+            trace_fname = argv[++i];
+        else
+            args.push_back(a);
+    }
+
+    const auto write_trace = [&trace_fname]()
+    {
+        if (!trace_fname.empty() && Profiler::get().write_chrome_trace(trace_fname))
+            cout << "cannot write trace " << trace_fname << "\n";
+    };
+
+    if (bench)
+    {
+        BenchConfig cfg;
+        for (size_t i = 1; i < args.size(); ++i)
+            if (!cfg.set(args[i]))
+            {
+                cout << "invalid benchmark option " << args[i] << "\n";
+                return -1;
+            }
+
+        const auto err = run_benchmark(cfg, cout);
+        write_trace();
+        return err;
+    }
+
+    // ============== READ INPUT ==============
+    if (args.size() >= 2)
+    {
+        fname = args[1];
+        cout << "read file " << fname << "\n";
+    }
+    else
+        return -1;
+
+    // optional: solver for part 1 (gf2, bfs, mitm or batch)
+    auto light_solver = LightSolver::GF2;
+    if (args.size() >= 3)
+    {
+        const string s = args[2];
+        if (s == "bfs")
+            light_solver = LightSolver::BFS;
+        else if (s == "mitm")
+            light_solver = LightSolver::MITM;
+        else if (s == "batch")
+            light_solver = LightSolver::BATCH;
+        else if (s != "gf2")
+        {
+            cout << "unknown solver " << s << "\n";
+            return -1;
+        }
+    }
+
+    // optional: solver for part 2 (ilp, halving or check to compare both),
+    // machines too large for halving always use the ilp
+    auto joltage_solver = JoltageSolver::ILP;
+    if (args.size() >= 4)
+    {
+        const string s = args[3];
+        if (s == "halving")
+            joltage_solver = JoltageSolver::HALVING;
+        else if (s == "check")
+            joltage_solver = JoltageSolver::CHECK;
+        else if (s != "ilp")
+        {
+            cout << "unknown solver " << s << "\n";
+            return -1;
+        }
+    }
+
+    // optional: file to keep solutions between runs
+    string cache_fname;
+    if (args.size() >= 5)
+        cache_fname = args[4];
+
+    if (stream)
+    {
+        Profiler::get().max_events = STREAM_TRACE_EVENTS;
+
+        SolutionCache cache;
+        if (!cache_fname.empty() && cache.load(cache_fname))
+            cout << "cannot read cache " << cache_fname << ", start empty\n";
+        cache.limit(STREAM_CACHE_ENTRIES);
+
+        StreamResult r;
+        TraceScope span("stream");
+        if (stream_machines(fname, light_solver, joltage_solver, cache, r))
+        {
+            cout << "cannot read file " << fname << "\n";
+            return -1;
+        }
+        span.stop();
+        cout << "solved " << r.n_machines << " machines in " << span.ms() << "(ms), first after " << r.first_result_ms << "(ms)\n";
+        cout << "PART 1: min. amount of button pushes: " << r.lights << "\n";
+        cout << "PART 2: min. amount of button pushes: " << r.joltage << "\n";
+
+        if (!cache_fname.empty() && cache.save(cache_fname))
+            cout << "cannot write cache " << cache_fname << "\n";
+
+        Profiler::get().report(cout, "machine");
+        write_trace();
+        return 0;
+    }
+
+    TraceScope read_span("read input");
+    if (read_input(fname, machines))
+    {
+        cout << "cannot read file " << fname << "\n";
+        return -1;
+    }
+    read_span.stop();
+
+    cout << "read " << machines.size() << " lines in " << read_span.ms() << "(ms)\n";
+
+    const auto order = order_by_cost(machines);
+
+    SolutionCache cache;
+    if (!cache_fname.empty() && cache.load(cache_fname))
+        cout << "cannot read cache " << cache_fname << ", start empty\n";
+    cache.index(machines);
+
+    // ============== PART 1 ==============
+
+    cout << "=============== PART 1 ===============\n";
+    TraceScope part1_span("part 1");
+    auto min_push = switch_buttons(machines, order, cache, light_solver);
+    part1_span.stop();
+    cout << "min. amount of button pushes: " << min_push << " discovered in " << part1_span.ms() << "(ms)\n";
+
+    // ============== PART 2 ==============
+
+    cout << "=============== PART 2 ===============\n";
+    TraceScope part2_span("part 2");
+    min_push = get_joltage_button_press(machines, order, cache, joltage_solver);
+    part2_span.stop();
+    cout << "min. amount of button pushes: " << min_push << " discovered in " << part2_span.ms() << "(ms)\n";
+
+    cout << "=============== PROFILE ===============\n";
+    Profiler::get().report(cout, "lights");
+    Profiler::get().report(cout, "light batch");
+    Profiler::get().report(cout, "joltage");
+    write_trace();
+
+    if (!cache_fname.empty())
+    {
+        if (cache.save(cache_fname))
+            cout << "cannot write cache " << cache_fname << "\n";
+        else
+            cout << "saved " << cache.size() << " solutions to " << cache_fname << "\n";
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -12,44 +12,130 @@
 #include <unordered_set>
 #include <chrono>
 #include <queue>
+#include <memory_resource>
+#include <new>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 using namespace std;
 
 using et = long long;
 
-template <typename T>
-void vec_diff(const vector<T> &a, const vector<T> &b, vector<T> &x)
+// Monotonic arena for the points, the kd-tree and the groups. Memory is
+// mapped in 2 MB aligned blocks, optionally advised as transparent huge
+// pages, deallocate() does nothing and release() unmaps everything at once.
+class HugePageArena : public pmr::memory_resource
 {
-    if (a.size() != b.size())
+public:
+    constexpr static const size_t PAGE = size_t(2) << 20;
+
+    explicit HugePageArena(const bool huge_pages = true) : huge_pages{huge_pages} {}
+    HugePageArena(const HugePageArena &) = delete;
+    HugePageArena &operator=(const HugePageArena &) = delete;
+    ~HugePageArena() { release(); }
+
+    void release()
     {
-        return;
+        for (const auto &b : blocks)
+            munmap(b.first, b.second);
+        blocks.clear();
+        cur = end = nullptr;
+        used = mapped = 0;
     }
 
-    x.resize(a.size());
+    size_t bytes_used() const { return used; }
+    size_t bytes_mapped() const { return mapped; }
+    size_t n_blocks() const { return blocks.size(); }
+    bool uses_huge_pages() const { return huge_pages; }
 
-    for (size_t i = 0; i < a.size(); ++i)
-        x[i] = a[i] - b[i];
-}
+private:
+    bool huge_pages;
+    vector<pair<char *, size_t>> blocks;
+    char *cur = nullptr,
+         *end = nullptr;
+    size_t used = 0,
+           mapped = 0;
+
+    static char *align_up(char *p, const size_t align)
+    {
+        return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1));
+    }
+
+    void grow(const size_t min_size)
+    {
+        // blocks double in size, so the number of mappings stays small
+        const size_t size = max(blocks.empty() ? PAGE : blocks.back().second * 2,
+                                (min_size + PAGE - 1) / PAGE * PAGE);
+
+        // map one page more than needed and trim it to a 2 MB boundary
+        char *const raw = static_cast<char *>(mmap(nullptr, size + PAGE, PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED)
+            throw bad_alloc();
+
+        char *const p = align_up(raw, PAGE);
+        if (p > raw)
+            munmap(raw, p - raw);
+        if (p + size < raw + size + PAGE)
+            munmap(p + size, raw + size + PAGE - (p + size));
+
+#ifdef MADV_HUGEPAGE
+        if (huge_pages)
+            madvise(p, size, MADV_HUGEPAGE);
+#endif
+
+        blocks.push_back({p, size});
+        cur = p;
+        end = p + size;
+        mapped += size;
+    }
+
+    void *do_allocate(const size_t bytes, const size_t align) override
+    {
+        char *p = align_up(cur, align);
+        if (cur == nullptr || p + bytes > end)
+        {
+            grow(bytes + align);
+            p = align_up(cur, align);
+        }
+        cur = p + bytes;
+        used += bytes;
+        return p;
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+struct PageFaults
+{
+    long minor = 0,
+         major = 0;
+
+    static PageFaults now()
+    {
+        rusage u{};
+        getrusage(RUSAGE_SELF, &u);
+        return {u.ru_minflt, u.ru_majflt};
+    }
+};
 
 template <typename T>
-T straight_line_dist_squared(const vector<T> &v)
+T straight_line_dist_squared(const pmr::vector<T> &v1, const pmr::vector<T> &v2)
 {
+    // no temporary difference vector, this is called for every visited node
     T s = 0;
 
-    for (const auto &x : v)
-        s += x * x;
+    for (size_t i = 0; i < v1.size() && i < v2.size(); ++i)
+        s += (v1[i] - v2[i]) * (v1[i] - v2[i]);
 
     return s;
 }
 
-template <typename T>
-T straight_line_dist_squared(const vector<T> &v1, const vector<T> &v2)
-{
-    vector<T> diff;
-    vec_diff(v1, v2, diff);
-    return straight_line_dist_squared(diff);
-}
-
 using candidate = std::pair<et, size_t>;
 
 template <typename T>
@@ -57,10 +143,18 @@ struct Node
 {
     constexpr static const size_t END = numeric_limits<size_t>::max();
 
-    vector<T> p{0, 0, 0};
+    // the point is stored with the allocator of the node vector
+    using allocator_type = pmr::polymorphic_allocator<>;
+
+    pmr::vector<T> p{0, 0, 0};
 
     size_t left = END,
            right = END;
+
+    Node(const pmr::vector<T> &p, const allocator_type &a = {}) : p(p, a) {}
+    Node(const Node &n, const allocator_type &a = {}) : p(n.p, a), left{n.left}, right{n.right} {}
+    Node(Node &&n, const allocator_type &a) : p(std::move(n.p), a), left{n.left}, right{n.right} {}
+    Node(Node &&) = default;
 };
 template <typename T>
 struct NNQuery
@@ -70,19 +164,19 @@ struct NNQuery
         bool operator()(const candidate l, const candidate r) const { return l.first < r.first; }
     } custom_less;
 
-    vector<T> p{0, 0, 0};
+    pmr::vector<T> p{0, 0, 0};
     size_t n_nearest = 1;
     // vector<size_t> nearest;
     priority_queue<candidate, vector<candidate>, comp> nearest;
-    vector<Node<T>> *nodes = nullptr;
+    pmr::vector<Node<T>> *nodes = nullptr;
 
     vector<size_t> final_results;
 
-    NNQuery(size_t n_nearest, vector<Node<T>> *const nodes) : n_nearest{n_nearest}, nodes{nodes}
+    NNQuery(size_t n_nearest, pmr::vector<Node<T>> *const nodes) : n_nearest{n_nearest}, nodes{nodes}
     {
     }
 
-    void set_p(const vector<T> &p)
+    void set_p(const pmr::vector<T> &p)
     {
         this->p = p;
     }
@@ -192,14 +286,14 @@ struct NNQuery
         return final_results.at(n);
     }
 
-    vector<T> &get_nearest_point(const size_t n) const
+    pmr::vector<T> &get_nearest_point(const size_t n) const
     {
         return (*nodes)[get_nearest_idx(n)].p;
     }
 };
 
 template <typename T>
-void read_input(const string &fname, vector<vector<T>> &nums)
+void read_input(const string &fname, pmr::vector<pmr::vector<T>> &nums)
 {
     ifstream rfile;
     string line;
@@ -210,7 +304,7 @@ void read_input(const string &fname, vector<vector<T>> &nums)
     {
         while (getline(rfile, line))
         {
-            nums.push_back(vector<T>());
+            nums.emplace_back();
             size_t sep_pos_start = 0, sep_pos_end = 0;
 
             while (sep_pos_end < line.length())
@@ -233,7 +327,7 @@ void read_input(const string &fname, vector<vector<T>> &nums)
     cout << "Read nums; Size <" << nums.size() << ", " << nums.at(0).size() << ">" << endl;
 }
 template <typename T>
-void fill_distance_matrix(const vector<vector<T>> &n, vector<vector<T>> &d)
+void fill_distance_matrix(const pmr::vector<pmr::vector<T>> &n, pmr::vector<pmr::vector<T>> &d)
 {
     // build distance matrix
     d.resize(n.size());
@@ -261,7 +355,7 @@ struct SortedDistancePairs
     vector<array<K, 2>> dp;
     vector<K> index;
 
-    void fill(const vector<vector<T>> &dist)
+    void fill(const pmr::vector<pmr::vector<T>> &dist)
     {
         dp.clear();
 
@@ -280,7 +374,7 @@ struct SortedDistancePairs
         sort(dist);
     }
 
-    void sort(const vector<vector<T>> &dist)
+    void sort(const pmr::vector<pmr::vector<T>> &dist)
     {
         std::sort(dp.begin(), dp.end(), [&](const auto &a, const auto &b)
                   { return dist[a[0]][a[1]] < dist[b[0]][b[1]]; });
@@ -299,8 +393,8 @@ struct SortedDistancePairs
 };
 
 template <typename T>
-size_t insert_kd_tree(list<vector<T>> &p,
-                      vector<Node<T>> &n,
+size_t insert_kd_tree(pmr::list<pmr::vector<T>> &p,
+                      pmr::vector<Node<T>> &n,
                       size_t k)
 {
 
@@ -310,15 +404,15 @@ size_t insert_kd_tree(list<vector<T>> &p,
     p.sort([&d](const auto &x1, const auto &x2)
            { return x1[d] < x2[d]; });
 
-    // split into left and right list
-    list<vector<T>> rl;
+    // split into left and right list, splice needs the same allocator
+    pmr::list<pmr::vector<T>> rl(p.get_allocator());
     rl.splice(rl.begin(),
               p,
               next(p.begin(), p.size() / 2),
               p.end());
 
     // right list first element is point to insert
-    n.push_back({rl.front()});
+    n.emplace_back(rl.front());
     const auto ni = n.size() - 1; // save index of new node
     rl.pop_front();
 
@@ -336,7 +430,7 @@ size_t insert_kd_tree(list<vector<T>> &p,
 
 template <typename T>
 bool is_kd_tree(
-    const vector<Node<T>> &nodes,
+    const pmr::vector<Node<T>> &nodes,
     unordered_set<size_t> &visited,
     size_t root = 0,
     size_t depth = 0)
@@ -382,12 +476,16 @@ bool is_kd_tree(
 }
 
 template <typename T>
-void build_distance_tree(const vector<vector<T>> &p, vector<Node<T>> &n)
+void build_distance_tree(const pmr::vector<pmr::vector<T>> &p, pmr::vector<Node<T>> &n, const bool huge_pages)
 {
     if (!p.size())
         return;
 
-    list<vector<T>> pl;
+    // the list is only needed while the tree is built, it gets an arena of
+    // its own that is unmapped on return, the same kind of pages keep the
+    // sorts of the list as fast as in the main arena
+    HugePageArena scratch(huge_pages);
+    pmr::list<pmr::vector<T>> pl(&scratch);
     for (const auto &x : p)
         pl.push_back(x);
 
@@ -397,7 +495,7 @@ void build_distance_tree(const vector<vector<T>> &p, vector<Node<T>> &n)
 }
 
 template <typename T, typename K>
-pair<K, K> get_closest_pair(const vector<vector<T>> &dist, const T min_dist)
+pair<K, K> get_closest_pair(const pmr::vector<pmr::vector<T>> &dist, const T min_dist)
 {
     auto p = make_pair<K, K>(static_cast<K>(dist.size() > 0), 0);
 
@@ -413,9 +511,9 @@ pair<K, K> get_closest_pair(const vector<vector<T>> &dist, const T min_dist)
 }
 
 template <typename K>
-typename list<vector<K>>::iterator get_point_in_group(list<vector<K>> &groups, const K p)
+typename pmr::list<pmr::vector<K>>::iterator get_point_in_group(pmr::list<pmr::vector<K>> &groups, const K p)
 {
-    const auto q = [&p](const vector<K> &g)
+    const auto q = [&p](const pmr::vector<K> &g)
     {
         auto it = lower_bound(g.begin(), g.end(), p);
         if (it != g.end())
@@ -428,7 +526,7 @@ typename list<vector<K>>::iterator get_point_in_group(list<vector<K>> &groups, c
 }
 
 template <typename K>
-int join_groups(typename list<vector<K>>::iterator g1, typename list<vector<K>>::iterator g2, list<vector<K>> &g)
+int join_groups(typename pmr::list<pmr::vector<K>>::iterator g1, typename pmr::list<pmr::vector<K>>::iterator g2, pmr::list<pmr::vector<K>> &g)
 {
     if (g1 == g.end() || g2 == g.end())
     {
@@ -448,7 +546,7 @@ int join_groups(typename list<vector<K>>::iterator g1, typename list<vector<K>>:
 }
 
 template <typename T, typename K>
-void group_points(vector<Node<T>> &dist, list<vector<K>> &groups, const size_t ndist)
+void group_points(pmr::vector<Node<T>> &dist, pmr::list<pmr::vector<K>> &groups, const size_t ndist)
 {
 
     if (dist.empty() || ndist > dist.size())
@@ -460,7 +558,7 @@ void group_points(vector<Node<T>> &dist, list<vector<K>> &groups, const size_t n
     // init groups where every group contains one point
     groups.clear();
     for (size_t i = 0; i < dist.size(); ++i)
-        groups.push_back({i});
+        groups.emplace_back(1, i);
 
     for (size_t bi = 0; bi < ndist; ++bi)
     {
@@ -483,7 +581,7 @@ void group_points(vector<Node<T>> &dist, list<vector<K>> &groups, const size_t n
 }
 
 template <typename T, typename K>
-pair<K, K> group_points_to_n_groups(const SortedDistancePairs<T, K> &dist, list<vector<K>> &groups, const size_t ngroups)
+pair<K, K> group_points_to_n_groups(const SortedDistancePairs<T, K> &dist, pmr::list<pmr::vector<K>> &groups, const size_t ngroups)
 {
 
     if (dist.empty() || ngroups > dist.size())
@@ -492,7 +590,7 @@ pair<K, K> group_points_to_n_groups(const SortedDistancePairs<T, K> &dist, list<
     // init groups where every group contains one point
     groups.clear();
     for (const auto &i : dist.index)
-        groups.push_back({i});
+        groups.emplace_back(1, i);
 
     auto p = dist.get_pair(0);
     for (size_t bi = 0; bi < dist.size(); ++bi)
@@ -528,16 +626,24 @@ int main(int argc, char *argv[])
     using std::chrono::milliseconds;
 
     string fname = "input.txt";
-    vector<vector<et>> nums;
-    vector<Node<et>> nodes;
-    vector<vector<et>> dist;
-
     if (argc >= 2)
     {
         fname = argv[1];
         cout << "read file " << fname << endl;
     }
 
+    // optional: "4k" keeps the arena on normal pages
+    const bool huge_pages = argc < 5 || string(argv[4]) != "4k";
+
+    // everything of this run but the scratch list of build_distance_tree lives
+    // in the arena, it is released in one go when main returns, after the
+    // containers below are destroyed
+    const auto faults_start = PageFaults::now();
+    HugePageArena arena(huge_pages);
+    pmr::vector<pmr::vector<et>> nums(&arena);
+    pmr::vector<Node<et>> nodes(&arena);
+    pmr::vector<pmr::vector<et>> dist(&arena);
+
     size_t nbiggest = 3;
     if (argc >= 3)
     {
@@ -561,7 +667,7 @@ int main(int argc, char *argv[])
 
     auto t1 = high_resolution_clock::now();
     // build kd-tree (not used in this example, maybe use later for optimization)
-    build_distance_tree(nums, nodes);
+    build_distance_tree(nums, nodes, huge_pages);
     auto t2 = high_resolution_clock::now();
     auto ms_read = duration_cast<milliseconds>(t2 - t1);
     cout << "inserted " << nodes.size() << "/" << nums.size() << " nodes" << "\n";
@@ -570,7 +676,7 @@ int main(int argc, char *argv[])
     // ========== PART 1 ========== //
 
     // group the points
-    list<vector<size_t>> groups;
+    pmr::list<pmr::vector<size_t>> groups(&arena);
 
     t1 = high_resolution_clock::now();
     group_points(nodes, groups, ndist);
@@ -591,6 +697,12 @@ int main(int argc, char *argv[])
 
     cout << "Product of sizes of " << nbiggest << " biggest groups: " << bgp << "\n";
 
+    const auto faults = PageFaults::now();
+    cout << "arena: " << arena.bytes_used() << " bytes used, " << arena.bytes_mapped() << " bytes mapped in "
+         << arena.n_blocks() << " blocks" << (arena.uses_huge_pages() ? " (huge pages)" : "") << "\n";
+    cout << "page faults: " << faults.minor - faults_start.minor << " minor, "
+         << faults.major - faults_start.major << " major\n";
+
     // ========== PART 2 ========== //
     // t1 = high_resolution_clock::now();
     // const size_t ngroups = 1;